@@ -173,6 +173,20 @@
 #define MAX_HEATING_TEMPERATURE_INCREASE 10
 #define MAX_HEATING_CHECK_MILLIS (30 * 1000)
 
+//Model based heater fault detection. The temperature change of each hotend over HEATER_MODEL_WINDOW milliseconds is compared
+// with the change predicted from the applied heater power by a first order model:
+//   dT/dt = heating rate * power - loss * (T - HEATUP_AMBIENT)
+// The heating rate and loss are the ones learned for HEATUP_SYNCHRONIZE (see Configuration_adv.h), the check starts once the
+// loss has been learned from a hotend cooling down without power. It only runs while the hotend has a target temperature,
+// MAXTEMP covers a heater that is on without one.
+// If the measurement differs more then HEATER_MODEL_TOLERANCE degrees from the model for HEATER_MODEL_FAULT_WINDOWS windows in a row
+// the printer is stopped. This catches a failing heater cartridge, a temperature sensor that is not in the heater block, excessive
+// cooling or a heater that is stuck on. Experimental, off by default.
+//#define HEATER_MODEL_CHECK
+#define HEATER_MODEL_WINDOW 4000
+#define HEATER_MODEL_TOLERANCE 10
+#define HEATER_MODEL_FAULT_WINDOWS 3
+
 // If your bed has low resistance e.g. .6 ohm and throws the fuse you can duty cycle it to reduce the
 // average current. The value should be an integer and the heat bed will be turned on for 1 interval of
 // HEATER_BED_DUTY_CYCLE_DIVIDER intervals.
@@ -183,6 +197,7 @@
 #define PIDTEMP
 #define BANG_MAX 255 // limits current to nozzle while in bang-bang mode; 255=full current
 #define PID_MAX 255 // limits current to nozzle while PID is active (see PID_FUNCTIONAL_RANGE below); 255=full current
+#define PID_AUTOTUNE_TOLERANCE 0.05 // M303 stops as soon as Ku and Tu of two cycles in a row differ less than this fraction
 #ifdef PIDTEMP
   //#define PID_DEBUG // Sends debug data to the serial port.
   //#define PID_OPENLOOP 1 // Puts PID in open loop. M104/M140 sets the output power from 0 to PID_MAX
@@ -191,6 +206,7 @@
   #define PID_INTEGRAL_DRIVE_MAX 255  //limit for the integral term
   #define K1 0.99 //smoothing factor within the PID
   #define PID_dT ((OVERSAMPLENR * 4.0)/(F_CPU / 64.0 / 256.0)) //sampling period of the temperature routine
+  #define PID_FIXED_POINT // Run the hotend PID in integer math. Same terms and limits as the float PID, updatePID() converts Kp/Ki/Kd.
 
 // If you are using a preconfigured hotend then you can use one of the value sets by uncommenting it
 // Ultimaker
@@ -239,6 +255,20 @@
 // so you shouldn't use it unless you are OK with PWM on your bed.  (see the comment on enabling PIDTEMPBED)
 #define MAX_BED_POWER 255 // limits duty cycle to bed; 255=full current
 
+// Power budget for the heaters, so the bed and the hotends can heat at the same time without overloading the power supply.
+// The soft PWM on-times of the heaters are placed one after the other in the PWM period instead of all starting together,
+// and a heater is cut short where the heaters that are on at that moment would draw more than HEATER_POWER_BUDGET watts.
+// The active extruder gets its share first, then the other extruders, then the bed. HEATER_POWER_BED_FIRST serves the bed first.
+// A heater drawing more than the whole budget on its own never switches on.
+#define HEATER_POWER_BUDGET 180
+#ifdef HEATER_POWER_BUDGET
+  #define HEATER_0_WATTS 35
+  #define HEATER_1_WATTS 35
+  #define HEATER_2_WATTS 35
+  #define HEATER_BED_WATTS 140
+  //#define HEATER_POWER_BED_FIRST
+#endif
+
 #ifdef PIDTEMPBED
 //120v 250W silicone heater into 4mm borosilicate (MendelMax 1.5+)
 //from FOPDT model - kp=.39 Tp=405 Tdead=66, Tc set to 79.2, aggressive factor of .15 (vs .1, 1, 10)
@@ -257,7 +287,7 @@
     #define  DEFAULT_bedKi 23.46
     #define  DEFAULT_bedKd 165.29
 
-// FIND YOUR OWN: "M303 E-1 C8 S90" to run autotune on the bed at 90 degreesC for 8 cycles.
+// FIND YOUR OWN: "M303 E-1 C8 S90" to run autotune on the bed at 90 degreesC for at most 8 cycles.
 #endif // PIDTEMPBED
 
 
@@ -38,7 +38,7 @@ void _EEPROM_readData(int &pos, uint8_t* value, uint8_t size)
 // the default values are used whenever there is a change to the data, to prevent
 // wrong data being written to the variables.
 // ALSO:  always make sure the variables in the Store and retrieve sections are in the same order.
-#define EEPROM_VERSION "V12"
+#define EEPROM_VERSION "V13"
 
 #ifdef EEPROM_SETTINGS
 void Config_StoreSettings()
@@ -90,6 +90,16 @@ void Config_StoreSettings()
   #endif
   EEPROM_WRITE_VAR(i,retract_length);
   EEPROM_WRITE_VAR(i,retract_feedrate);
+  #ifdef PIDTEMPBED
+    EEPROM_WRITE_VAR(i,bedKp);
+    EEPROM_WRITE_VAR(i,bedKi);
+    EEPROM_WRITE_VAR(i,bedKd);
+  #else
+    float bedDummy = 0.0f;
+    EEPROM_WRITE_VAR(i,bedDummy);
+    EEPROM_WRITE_VAR(i,bedDummy);
+    EEPROM_WRITE_VAR(i,bedDummy);
+  #endif
   char ver2[4]=EEPROM_VERSION;
   i=EEPROM_OFFSET;
   EEPROM_WRITE_VAR(i,ver2); // validate data
@@ -162,6 +172,15 @@ void Config_PrintSettings()
     SERIAL_ECHOPAIR(" D" ,unscalePID_d(Kd));
     SERIAL_ECHOLN("");
 #endif
+#ifdef PIDTEMPBED
+    SERIAL_ECHO_START;
+    SERIAL_ECHOLNPGM("Bed PID settings:");
+    SERIAL_ECHO_START;
+    SERIAL_ECHOPAIR("   M304 P",bedKp);
+    SERIAL_ECHOPAIR(" I" ,unscalePID_i(bedKi));
+    SERIAL_ECHOPAIR(" D" ,unscalePID_d(bedKd));
+    SERIAL_ECHOLN("");
+#endif
 }
 #endif
 
@@ -174,7 +193,8 @@ void Config_RetrieveSettings()
     char ver[4]=EEPROM_VERSION;
     EEPROM_READ_VAR(i,stored_ver); //read stored version
     //  SERIAL_ECHOLN("Version: [" << ver << "] Stored version: [" << stored_ver << "]");
-    if (strncmp(ver,stored_ver,3) == 0)
+    //V12 is the same as V13 without the bed PID values at the end, so those settings are kept.
+    if (strncmp(ver,stored_ver,3) == 0 || strncmp_P(stored_ver, PSTR("V12"), 3) == 0)
     {
         // version number match
         EEPROM_READ_VAR(i,axis_steps_per_unit);
@@ -221,6 +241,15 @@ void Config_RetrieveSettings()
         #endif
         EEPROM_READ_VAR(i,retract_length);
         EEPROM_READ_VAR(i,retract_feedrate);
+        if (strncmp(ver,stored_ver,3) == 0)
+        {
+            #ifndef PIDTEMPBED
+            float bedKp,bedKi,bedKd;
+            #endif
+            EEPROM_READ_VAR(i,bedKp);
+            EEPROM_READ_VAR(i,bedKi);
+            EEPROM_READ_VAR(i,bedKd);
+        }
 
 		// Call updatePID (similar to when we have processed M301)
 		updatePID();
@@ -281,9 +310,16 @@ void Config_ResetDefault()
     updatePID();
 
 #ifdef PID_ADD_EXTRUSION_RATE
-    Kc = DEFAULT_Kc;
+    for(uint8_t e=0; e<EXTRUDERS; e++)
+        Kc[e] = DEFAULT_Kc;
 #endif//PID_ADD_EXTRUSION_RATE
 #endif//PIDTEMP
+#ifdef PIDTEMPBED
+    bedKp = DEFAULT_bedKp;
+    bedKi = scalePID_i(DEFAULT_bedKi);
+    bedKd = scalePID_d(DEFAULT_bedKd);
+    updatePID();
+#endif//PIDTEMPBED
     float tmp_motor_current_setting[]=DEFAULT_PWM_MOTOR_CURRENT;
     motor_current_setting[0] = tmp_motor_current_setting[0];
     motor_current_setting[1] = tmp_motor_current_setting[1];
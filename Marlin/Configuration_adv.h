@@ -24,12 +24,43 @@
 // if CooldownNoWait is defined M109 will not wait for the cooldown to finish
 #define CooldownNoWait true
 
+// Convert the raw temperature readings with the direct indexed tables from thermistortables_indexed.h (one entry
+// per ADC value) instead of scanning the thermistortables.h table. This costs about 2KB flash per used table.
+// After changing a table in thermistortables.h, regenerate thermistortables_indexed.h with createTemperatureLookupMarlin.py
+// and check it with --check-indexed. Sensors whose table has no indexed version (type 6) keep scanning the table.
+#define TEMP_TABLES_DIRECT_INDEX
+
+// Keep the last TEMP_HISTORY_SIZE (time, temperature, target, PWM) samples of every heater, M155 dumps them as CSV or streams new ones.
+// A sample is taken every TEMP_HISTORY_INTERVAL temperature measurements (one measurement is PID_dT, about 33ms).
+// RAM use is (2 + 5 * heaters) * TEMP_HISTORY_SIZE bytes, 388 bytes on the UM2. Diagnostic feature, off by default.
+//#define TEMP_HISTORY
+#ifdef TEMP_HISTORY
+  #define TEMP_HISTORY_SIZE 32
+  #define TEMP_HISTORY_INTERVAL 8
+#endif
+
+// Start the bed and hotend heaters of an UltiGCode print so they reach their targets together, instead of heating the bed first.
+// The heater with the longest estimated heat-up time starts at once, the others start when their own estimate reaches the time
+// the slowest heater still needs. Estimates use the heating rate (degC per second at full power) learned while heating and the
+// loss (fraction of the temperature above HEATUP_AMBIENT lost per second) learned while cooling down without power.
+#define HEATUP_SYNCHRONIZE
+#ifdef HEATUP_SYNCHRONIZE
+  #define DEFAULT_HEATUP_RATE_HOTEND 2.5
+  #define DEFAULT_HEATUP_RATE_BED 0.5
+  #define HEATUP_RATE_WINDOW 5000 // Milliseconds of full or no power per learned heating rate or loss sample
+  #define HEATUP_AMBIENT 20
+  #define HEATUP_LOSS_MIN_TEMPERATURE 30 // Degrees above ambient needed to learn the loss, closer to ambient the drop is too small to measure
+  #define HEATUP_LOSS_MIN_DROP 5         // Degrees the temperature has to drop without power for a loss sample, the window grows until it has
+  #define HEATUP_SYNC_MARGIN 5    // Seconds the faster heaters start early, as the heating rate drops close to the target
+#endif
+
 #ifdef PIDTEMP
   // this adds an experimental additional term to the heatingpower, proportional to the extrusion speed.
   // if Kc is choosen well, the additional required power due to increased melting should be compensated.
+  // Kc is in PWM steps per mm/s of filament. UltiGCode prints take it from the material profile, M301 C sets it directly.
   #define PID_ADD_EXTRUSION_RATE
   #ifdef PID_ADD_EXTRUSION_RATE
-    #define  DEFAULT_Kc (1) //heatingpower=Kc*(e_speed)
+    #define  DEFAULT_Kc (0) //heatingpower=Kc*(e_speed)
   #endif
 #endif
 
@@ -200,6 +231,20 @@
 // Microstep setting (Only functional when stepper driver microstep pins are connected to MCU.
 #define MICROSTEP_MODES {16,16,16,16,16} // [1,2,4,8,16]
 
+// Dynamic microstepping: long and fast travel moves (no E and no Z movement) run with the X/Y drivers switched to
+// a coarser microstep mode, which divides the step event rate by 2^DYNAMIC_MICROSTEP_SHIFT. The planner splits such
+// a move so the coarse part starts and ends on a coarse step boundary, the position in steps stays exact.
+// The next block that is not a coarse travel switches the drivers back to the mode last set with M350.
+// The boundary follows the translator phase of the drivers from power up through G92 and homing. M350 to another
+// mode or M351 on X/Y lose that phase, coarse travel stays off on that axis until the next power cycle.
+// Only functional when stepper driver microstep pins are connected to MCU. Can be switched off with M352 S0.
+//#define DYNAMIC_MICROSTEPPING
+#ifdef DYNAMIC_MICROSTEPPING
+  #define DYNAMIC_MICROSTEP_SHIFT 2           // 16 -> 4 microsteps
+  #define DYNAMIC_MICROSTEP_MIN_FEEDRATE 100  // (mm/sec) only travel moves at least this fast are coarse
+  #define DYNAMIC_MICROSTEP_MIN_LENGTH 10     // (mm) only travel moves at least this long are coarse
+#endif
+
 // Motor Current setting (Only functional when motor driver current ref pins are connected to a digital trimpot on supported boards)
 #define DIGIPOT_MOTOR_CURRENT {135,135,135,135,135} // Values 0-255 (RAMBO 135 = ~0.75A, 185 = ~1A)
 
@@ -213,6 +258,37 @@
 #define SD_FINISHED_STEPPERRELEASE true  //if sd support and the file is finished: disable steppers?
 #define SD_FINISHED_RELEASECOMMAND "M84 X Y Z E" // You might want to keep the z enabled so your bed stays in place.
 
+// SD printing reads the file in chunks of SD_READ_BUFFER_SIZE bytes (never crossing a 512 byte block) and hands the
+// command reader one character at a time from RAM, instead of a full SdBaseFile::read() call per character.
+// 0 disables the read-ahead buffer.
+#define SD_READ_BUFFER_SIZE 128
+
+// Counting the files of the working directory also records the directory position of every n-th listed entry, with n
+// chosen so the whole directory fits in SD_DIR_INDEX_SIZE slots of 2 bytes. Fetching a filename by number then seeks to
+// the nearest recorded entry instead of scanning the directory from the start. 0 disables the index.
+#define SD_DIR_INDEX_SIZE 32
+
+// Directory listings (LCD menu and M20 filename lookups by number) are sorted folders first, then by SD_SORT_DEFAULT:
+// 0 directory order, 1 name, 2 newest first. M34 S<mode> changes the order from the next listing on.
+// The sort keeps a one byte entry number for the SD_SORT_LIMIT entries of the whole directory that are listed first, the
+// other entries follow them in directory order. The order of the last sorted directory is kept until a file is written or removed, so re-listing it
+// does not sort again. 0 disables sorting.
+#define SD_SORT_LIMIT 64
+#define SD_SORT_DEFAULT 1
+
+// Files written with M28 or M928 get their clusters reserved SD_WRITE_PREALLOCATE bytes at a time as one contiguous
+// group, instead of one FAT update per cluster while the upload is running. The unused part of the last group is freed
+// again when the file is closed with M29. 0 disables preallocation.
+#define SD_WRITE_PREALLOCATE 262144
+
+// Record a checkpoint of SD prints in EEPROM at most every PRINT_CHECKPOINT_INTERVAL seconds, so after a power loss the
+// print can be resumed from the LCD. A checkpoint is the file position of a command, taken once the moves in front of it
+// are finished, with the position, feedrate, temperatures, fan speed and active extruder in front of it. It is written a
+// byte at a time from the main loop whenever the EEPROM is ready, so it never waits for the EEPROM. M413 reports the
+// time spent on it. Binary G-code files are not checkpointed.
+#define PRINT_CHECKPOINT
+#define PRINT_CHECKPOINT_INTERVAL 60
+
 // The hardware watchdog should reset the Microcontroller disabling all outputs, in case the firmware gets stuck and doesn't do temperature regulation.
 #define USE_WATCHDOG
 
@@ -290,9 +366,34 @@ const unsigned int dropsegments=5; //everything with less than this number of st
 #endif
 
 
-//The ASCII buffer for recieving from the serial:
+//The ASCII buffer for recieving from the serial and the SD card. Commands are stored back to back in a ring buffer of
+//CMDBUFFER_SIZE bytes, so a short line (most G1 moves are under 40 characters) only takes its own length instead of
+//MAX_CMD_SIZE. BUFSIZE is the maximum number of queued commands. A new line is only read while MAX_CMD_SIZE+1 bytes are
+//free in one piece, so CMDBUFFER_SIZE must be at least 2*(MAX_CMD_SIZE+1).
 #define MAX_CMD_SIZE 96
-#define BUFSIZE 8
+#define BUFSIZE 16
+#define CMDBUFFER_SIZE 640
+
+// Serial output goes through a TX_BUFFER_SIZE byte ring buffer that the UART data register empty interrupt sends, so printing
+// does not wait about 40us per character at 250000 baud. Must be a power of 2, up to 256. 0 writes every byte directly
+// (busy waiting). When the buffer is full the main loop waits for room, while code running with interrupts disabled (the
+// temperature and stepper interrupts) drops the byte instead of blocking.
+#define TX_BUFFER_SIZE 128
+
+// Binary G-code frames over the serial port, switched on by the host with M880. Moves are sent as packed fixed-point
+// records with a CRC and a sequence number, see binary_gcode.h. Decoded commands go into the same command buffer, moves
+// as the decoded record so they skip text parsing. SD files that start with the frame sync byte are read as binary frames,
+// createBinaryGcode.py converts G-code files to them. Costs 105 bytes of RAM (the decoders of the serial port and the SD card).
+//#define BINARY_GCODE
+
+// Extend the "ok" that answers a command to "ok N<last line number> P<free planner blocks> B<free command buffer slots>".
+// Hosts can then keep several lines in flight instead of waiting for an "ok" before every line: count the bytes (newline
+// included) of every line sent but not answered yet, and keep that below the RX_BUFFER_SIZE that M115 reports (128).
+// Every line gets exactly one of these "ok"s, in order, no earlier than when it left the receive buffer, so the receive buffer
+// cannot overrun. Only "ok" lines with these fields count, M280/M301/M304 print an extra "ok" line with their values first.
+// Empty and comment-only lines get no answer, so do not send them. B counts the commands that surely fit, taking every
+// command as MAX_CMD_SIZE characters. Off by default, as it changes the "ok" line that every host reads.
+//#define ADVANCED_OK
 
 
 // Firmware based and LCD controled retract
@@ -324,6 +425,10 @@ const unsigned int dropsegments=5; //everything with less than this number of st
   #error "You cannot use TEMP_SENSOR_1_AS_REDUNDANT if EXTRUDERS > 1"
 #endif
 
+#if defined(HEATER_MODEL_CHECK) && !defined(HEATUP_SYNCHRONIZE)
+  #error "HEATER_MODEL_CHECK uses the heating rates learned for HEATUP_SYNCHRONIZE"
+#endif
+
 #if TEMP_SENSOR_0 > 0
   #define THERMISTORHEATER_0 TEMP_SENSOR_0
   #define HEATER_0_USES_THERMISTOR
@@ -155,6 +155,7 @@ enum AxisEnum {X_AXIS=0, Y_AXIS=1, Z_AXIS=2, E_AXIS=3};
 
 void FlushSerialRequestResend();
 void ClearToSend();
+void SendOk();
 
 void get_coordinates();
 #ifdef DELTA
@@ -171,6 +172,7 @@ void kill();
 #define STOP_REASON_XY_ENDSTOP_BROKEN_ERROR 7
 #define STOP_REASON_XY_ENDSTOP_STUCK_ERROR  8
 #define STOP_REASON_SAFETY_TRIGGER       10
+#define STOP_REASON_HEATER_RUNAWAY       11
 void Stop(uint8_t reasonNr);
 
 bool IsStopped();
@@ -30,6 +30,9 @@
 
 #if UART_PRESENT(SERIAL_PORT)
   ring_buffer rx_buffer  =  { { 0 }, 0, 0 };
+#if TX_BUFFER_SIZE > 0
+  tx_ring_buffer tx_buffer  =  { { 0 }, 0, 0 };
+#endif
 #endif
 
 FORCE_INLINE void store_char(unsigned char c)
@@ -58,6 +61,27 @@ FORCE_INLINE void store_char(unsigned char c)
   }
 #endif
 
+#if TX_BUFFER_SIZE > 0
+// Send the next byte of the transmit buffer, called when the data register is empty.
+FORCE_INLINE void send_tx_char()
+{
+  M_UDRx = tx_buffer.buffer[tx_buffer.tail];
+  tx_buffer.tail = (tx_buffer.tail + 1) & (TX_BUFFER_SIZE - 1);
+  if (tx_buffer.head == tx_buffer.tail)
+    cbi(M_UCSRxB, M_UDRIEx);
+}
+
+#if defined(M_USARTx_UDRE_vect)
+  SIGNAL(M_USARTx_UDRE_vect)
+  {
+    if (tx_buffer.head == tx_buffer.tail)
+      cbi(M_UCSRxB, M_UDRIEx);
+    else
+      send_tx_char();
+  }
+#endif
+#endif
+
 // Constructors ////////////////////////////////////////////////////////////////
 
 MarlinSerial::MarlinSerial()
@@ -142,6 +166,40 @@ void MarlinSerial::flush()
   rx_buffer.head = rx_buffer.tail;
 }
 
+#if TX_BUFFER_SIZE > 0
+void MarlinSerial::write(uint8_t c)
+{
+  //Nothing queued and the data register is free, so skip the buffer.
+  if (tx_buffer.head == tx_buffer.tail && (M_UCSRxA & (1 << M_UDREx)))
+  {
+    M_UDRx = c;
+    return;
+  }
+  uint8_t i = (tx_buffer.head + 1) & (TX_BUFFER_SIZE - 1);
+  if (i == tx_buffer.tail)
+  {
+    //Full. With interrupts disabled we are in an interrupt (or kill()), where waiting for room is not an option.
+    if (!(SREG & (1 << SREG_I)))
+      return;
+    while (i == tx_buffer.tail)
+      ;
+  }
+  tx_buffer.buffer[tx_buffer.head] = c;
+  tx_buffer.head = i;
+  sbi(M_UCSRxB, M_UDRIEx);
+}
+
+//Send everything in the transmit buffer by polling, this also works with interrupts disabled.
+void MarlinSerial::flushTx()
+{
+  while (tx_buffer.head != tx_buffer.tail)
+  {
+    if (M_UCSRxA & (1 << M_UDREx))
+      send_tx_char();
+  }
+}
+#endif
+
 
 
 
@@ -54,6 +54,8 @@
 #define M_UBRRxL SERIAL_REGNAME(UBRR,SERIAL_PORT,L)
 #define M_RXCx SERIAL_REGNAME(RXC,SERIAL_PORT,)
 #define M_USARTx_RX_vect SERIAL_REGNAME(USART,SERIAL_PORT,_RX_vect)
+#define M_UDRIEx SERIAL_REGNAME(UDRIE,SERIAL_PORT,)
+#define M_USARTx_UDRE_vect SERIAL_REGNAME(USART,SERIAL_PORT,_UDRE_vect)
 #define M_U2Xx SERIAL_REGNAME(U2X,SERIAL_PORT,)
 
 
@@ -84,6 +86,20 @@ struct ring_buffer
   extern ring_buffer rx_buffer;
 #endif
 
+#if TX_BUFFER_SIZE > 0
+// The main code writes at head, the UDRE interrupt sends from tail.
+struct tx_ring_buffer
+{
+  unsigned char buffer[TX_BUFFER_SIZE];
+  volatile uint8_t head;
+  volatile uint8_t tail;
+};
+
+#if UART_PRESENT(SERIAL_PORT)
+  extern tx_ring_buffer tx_buffer;
+#endif
+#endif
+
 class MarlinSerial //: public Stream
 {
 
@@ -100,6 +116,10 @@ class MarlinSerial //: public Stream
       return (unsigned int)(RX_BUFFER_SIZE + rx_buffer.head - rx_buffer.tail) % RX_BUFFER_SIZE;
     }
 
+#if TX_BUFFER_SIZE > 0
+    void write(uint8_t c);
+    void flushTx(void);
+#else
     FORCE_INLINE void write(uint8_t c)
     {
       while (!((M_UCSRxA) & (1 << M_UDREx)))
@@ -107,6 +127,8 @@ class MarlinSerial //: public Stream
 
       M_UDRx = c;
     }
+    FORCE_INLINE void flushTx(void) {}
+#endif
 
 
     FORCE_INLINE void checkRx(void)
@@ -40,6 +40,8 @@
 #include "ConfigurationStore.h"
 #include "lifetime_stats.h"
 #include "electronics_test.h"
+#include "binary_gcode.h"
+#include "print_checkpoint.h"
 #include "language.h"
 #include "pins_arduino.h"
 
@@ -95,6 +97,8 @@
 // M29  - Stop SD write
 // M30  - Delete file from SD (M30 filename.g)
 // M31  - Output time since last M109 or SD card start to serial
+// M34  - Set the SD file listing order S0 directory order, S1 by name, S2 newest first. Folders are listed first. Applies from the next listing.
+// M39  - Report SD block cache and FAT entry cache hits and misses, S0 clears the counters after reporting
 // M42  - Change pin status via gcode Use M42 Px Sy to set pin x to value y, when omitting Px the onboard led will be used.
 // M80  - Turn on Power Supply
 // M81  - Turn off Power Supply
@@ -108,6 +112,7 @@
 // M115 - Capabilities string
 // M117 - display message
 // M119 - Output Endstop status to serial port
+// M155 - Dump the temperature history as CSV, S1 dumps and then streams every new sample, S0 stops streaming (requires TEMP_HISTORY)
 // M126 - Solenoid Air Valve Open (BariCUDA support by jmil)
 // M127 - Solenoid Air Valve Closed (BariCUDA vent to atmospheric pressure by jmil)
 // M128 - EtoP Open (BariCUDA EtoP = electricity to air pressure transducer by jmil)
@@ -130,12 +135,14 @@
 // M240 - Trigger a camera to take a photograph
 // M280 - set servo position absolute. P: servo index, S: angle or microseconds
 // M300 - Play beepsound S<frequency Hz> P<duration ms>
-// M301 - Set PID parameters P I and D
+// M301 - Set PID parameters P I and D, C sets the extrusion rate feed forward of the active extruder
 // M302 - Allow cold extrudes, or set the minimum extrude S<temperature>.
-// M303 - PID relay autotune S<temperature> sets the target temperature. (default target temperature = 150C)
+// M303 - PID relay autotune S<temperature> sets the target temperature. (default target temperature = 150C) E<extruder, -1 for the bed> C<maximum cycles>.
+//        Stops once the cycles agree, then the new constants are active. M500 stores them in EEPROM.
 // M304 - Set bed PID parameters P I and D
 // M400 - Finish all moves
 // M401 - Cancel as many moves as possible
+// M413 - Report the print checkpoint that can be resumed and the time spent writing checkpoints (requires PRINT_CHECKPOINT)
 // M500 - stores paramters in EEPROM
 // M501 - reads parameters from EEPROM (if you need reset them after you changed them temporarily).
 // M502 - reverts to the default "factory settings".  You still need to store them in EEPROM afterwards if you want to.
@@ -146,7 +153,9 @@
 // M908 - Control digital trimpot directly.
 // M350 - Set microstepping mode.
 // M351 - Toggle MS1 MS2 pins directly.
+// M352 - Enable/disable dynamic microstepping for fast travel moves S[0|1] (requires DYNAMIC_MICROSTEPPING)
 // M923 - Select file and start printing directly (can be used from other SD file)
+// M880 - Switch the serial port to binary G-code frames, S<first sequence number> (requires BINARY_GCODE, see binary_gcode.h)
 // M928 - Start SD logging (M928 filename.g) - ended by M29
 // M999 - Restart after being stopped by error
 
@@ -241,8 +250,20 @@ static long gcode_N, gcode_LastN, Stopped_gcode_LastN = 0;
 
 static bool relative_mode = false;  //Determines Absolute or Relative Coordinates
 
-static char cmdbuffer[BUFSIZE][MAX_CMD_SIZE];
-static bool fromsd[BUFSIZE];
+//Command queue. Every entry is a source byte followed by the zero terminated command text, entries are stored back to back.
+//Entries with CMD_SOURCE_MOVE in the source byte hold a binary_gcode_move_t instead of text. CMD_SOURCE_CHECKPOINT marks
+//the SD command that the next print checkpoint is taken in front of.
+//bufindr and bufindw are byte offsets of the oldest entry and of the entry being received. An entry never wraps around the
+//end of the buffer, instead the writer leaves a CMD_SOURCE_WRAP byte behind and continues at the start.
+#define CMD_SOURCE_SERIAL 0
+#define CMD_SOURCE_SD     1
+#define CMD_SOURCE_MOVE   2
+#define CMD_SOURCE_CHECKPOINT 4
+#define CMD_SOURCE_WRAP   0xFF
+#define CMD_TEXT(index) (&cmdbuffer[(index) + 1])
+#define CMD_FROMSD(index) (cmdbuffer[index] & CMD_SOURCE_SD)
+#define CMD_ISMOVE(index) (cmdbuffer[index] & CMD_SOURCE_MOVE)
+static char cmdbuffer[CMDBUFFER_SIZE];
 static int bufindr = 0;
 static int bufindw = 0;
 static int buflen = 0;
@@ -252,6 +273,21 @@ static int serial_count = 0;
 static boolean comment_mode = false;
 static char *strchr_pointer; // just a pointer to find chars in the cmd string like X, Y, Z, E, etc
 
+//The command line that is being checked or executed, tokenized in a single pass by parse_command().
+//For the first occurrence of every letter it holds the position in the line and the number behind it
+//as a fixed point value (mantissa / 10^decimals), so code_seen() and code_value() never rescan the line.
+#define PARSED_NONE 0xFF
+static struct {
+  const char *cmd;
+  uint8_t pos[26];          //Position of each letter A-Z in cmd, PARSED_NONE when the letter is absent
+  uint8_t decimals[26];
+  long mantissa[26];
+  uint8_t checksum_pos;     //Position of the '*', PARSED_NONE when the line has no checksum
+  uint8_t checksum;         //XOR of all characters in front of the '*'
+  long checksum_value;      //The checksum sent behind the '*'
+} parsed;
+static uint8_t code_letter; //Letter of the last successful code_seen()
+
 const int sensitive_pins[] = SENSITIVE_PINS; // Sensitive pin list for M42
 
 //static float tt = 0;
@@ -305,12 +341,88 @@ extern "C"{
   }
 }
 
+//Make sure a command of up to MAX_CMD_SIZE characters can be received at bufindw, moving bufindw to the start of the buffer
+//when the end is too short. Returns false when the queue is full.
+static bool cmd_queue_writable()
+{
+  if (buflen >= BUFSIZE)
+    return false;
+  if (bufindw < bufindr)
+    return bufindr - bufindw >= MAX_CMD_SIZE + 1;
+  if (buflen > 0 && bufindw == bufindr)
+    return false;
+  if (CMDBUFFER_SIZE - bufindw >= MAX_CMD_SIZE + 1)
+    return true;
+  if (buflen == 0)
+  {
+    bufindr = bufindw = 0;
+    return true;
+  }
+  if (bufindr < MAX_CMD_SIZE + 1)
+    return false;
+  if (bufindw < CMDBUFFER_SIZE)
+    cmdbuffer[bufindw] = CMD_SOURCE_WRAP;
+  bufindw = 0;
+  return true;
+}
+
+#ifdef ADVANCED_OK
+//Number of commands that surely fit in the queue: free entries, but also no more than the free bytes hold commands of
+//MAX_CMD_SIZE characters, as an entry never wraps around the end of the buffer.
+static int cmd_queue_free()
+{
+  int free = BUFSIZE - buflen;
+  int room;
+  if (buflen == 0)
+    room = CMDBUFFER_SIZE / (MAX_CMD_SIZE + 1);
+  else if (bufindw < bufindr)
+    room = (bufindr - bufindw) / (MAX_CMD_SIZE + 1);
+  else if (bufindw == bufindr)
+    room = 0;
+  else
+    room = (CMDBUFFER_SIZE - bufindw) / (MAX_CMD_SIZE + 1) + bufindr / (MAX_CMD_SIZE + 1);
+  return min(free, room);
+}
+#endif
+
+//Size of the queue entry at index, source byte included.
+static int cmd_entry_size(int index)
+{
+#ifdef BINARY_GCODE
+  if (CMD_ISMOVE(index))
+    return 1 + sizeof(binary_gcode_move_t);
+#endif
+  return strlen(CMD_TEXT(index)) + 2;
+}
+
+//Add the command text received at bufindw to the queue.
+static void cmd_queue_commit(uint8_t source)
+{
+  cmdbuffer[bufindw] = source;
+  bufindw += cmd_entry_size(bufindw);
+  buflen += 1;
+}
+
+//Remove the oldest command from the queue.
+static void cmd_queue_pop()
+{
+  buflen -= 1;
+  if (buflen == 0)
+  {
+    bufindr = bufindw;
+    return;
+  }
+  bufindr += cmd_entry_size(bufindr);
+  if (bufindr >= CMDBUFFER_SIZE || (uint8_t)cmdbuffer[bufindr] == CMD_SOURCE_WRAP)
+    bufindr = 0;
+}
+
 //Clear all the commands in the ASCII command buffer, to make sure we have room for abort commands.
 void clear_command_queue()
 {
     if (buflen > 0)
     {
-        bufindw = (bufindr + 1)%BUFSIZE;
+        bufindw = bufindr + cmd_entry_size(bufindr);
         buflen = 1;
     }
 }
@@ -320,31 +432,29 @@ void clear_command_queue()
 //needs overworking someday
 void enquecommand(const char *cmd)
 {
-  if(buflen < BUFSIZE)
+  if(cmd_queue_writable())
   {
     //this is dangerous if a mixing of serial and this happsens
-    strcpy(&(cmdbuffer[bufindw][0]),cmd);
+    strcpy(CMD_TEXT(bufindw),cmd);
     SERIAL_ECHO_START;
     SERIAL_ECHOPGM("enqueing \"");
-    SERIAL_ECHO(cmdbuffer[bufindw]);
+    SERIAL_ECHO(CMD_TEXT(bufindw));
     SERIAL_ECHOLNPGM("\"");
-    bufindw= (bufindw + 1)%BUFSIZE;
-    buflen += 1;
+    cmd_queue_commit(CMD_SOURCE_SERIAL);
   }
 }
 
 void enquecommand_P(const char *cmd)
 {
-  if(buflen < BUFSIZE)
+  if(cmd_queue_writable())
   {
     //this is dangerous if a mixing of serial and this happsens
-    strcpy_P(&(cmdbuffer[bufindw][0]),cmd);
+    strcpy_P(CMD_TEXT(bufindw),cmd);
     SERIAL_ECHO_START;
     SERIAL_ECHOPGM("enqueing \"");
-    SERIAL_ECHO(cmdbuffer[bufindw]);
+    SERIAL_ECHO(CMD_TEXT(bufindw));
     SERIAL_ECHOLNPGM("\"");
-    bufindw= (bufindw + 1)%BUFSIZE;
-    buflen += 1;
+    cmd_queue_commit(CMD_SOURCE_SERIAL);
   }
 }
 
@@ -458,14 +568,13 @@ void setup()
   SERIAL_ECHO(freeMemory());
   SERIAL_ECHOPGM(MSG_PLANNER_BUFFER_BYTES);
   SERIAL_ECHOLN((int)sizeof(block_t)*BLOCK_BUFFER_SIZE);
-  for(int8_t i = 0; i < BUFSIZE; i++)
-  {
-    fromsd[i] = false;
-  }
 
   // loads data from EEPROM if available else uses defaults (and resets step acceleration rate)
   Config_RetrieveSettings();
   lifetime_stats_init();
+#ifdef PRINT_CHECKPOINT
+  print_checkpoint_init();
+#endif
   tp_init();    // Initialize temperature loop
   plan_init();  // Initialize planner;
   watchdog_init();
@@ -493,16 +602,26 @@ void loop()
     #ifdef SDSUPPORT
       if(card.saving)
       {
-        if(strstr_P(cmdbuffer[bufindr], PSTR("M29")) == NULL)
+        char* cmd = CMD_TEXT(bufindr);
+#ifdef BINARY_GCODE
+        //Moves from binary frames are queued as records, the file gets them as text.
+        char move_text[MAX_CMD_SIZE];
+        if (CMD_ISMOVE(bufindr))
         {
-          card.write_command(cmdbuffer[bufindr]);
+          binary_gcode_move_text((const binary_gcode_move_t*)cmd, move_text);
+          cmd = move_text;
+        }
+#endif
+        if(strstr_P(cmd, PSTR("M29")) == NULL)
+        {
+          card.write_command(cmd);
           if(card.logging)
           {
             process_commands();
           }
           else
           {
-            SERIAL_PROTOCOLLNPGM(MSG_OK);
+            SendOk();
           }
         }
         else
@@ -519,10 +638,7 @@ void loop()
       process_commands();
     #endif //SDSUPPORT
     if (buflen > 0)
-    {
-      buflen = (buflen-1);
-      bufindr = (bufindr + 1)%BUFSIZE;
-    }
+      cmd_queue_pop();
   }
   //check heater every n milliseconds
   manage_heater();
@@ -530,11 +646,320 @@ void loop()
   checkHitEndstops();
   lcd_update();
   lifetime_stats_tick();
+#ifdef PRINT_CHECKPOINT
+  print_checkpoint_tick();
+#endif
 }
 
+static const uint32_t pow10_table[] PROGMEM = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+//Parse the number at *p the way strtod() would for G-code values ([spaces][sign]digits[.digits]), into mantissa and decimals.
+static const char *parse_number(const char *p, long *mantissa, uint8_t *decimals)
+{
+  long value = 0;
+  uint8_t dec = 0;
+  bool negative = false;
+  bool fraction = false;
+
+  while(*p == ' ' || *p == '\t')
+    p++;
+  if (*p == '-' || *p == '+')
+    negative = (*p++ == '-');
+  for(;; p++)
+  {
+    if (*p >= '0' && *p <= '9')
+    {
+      //Digits behind the dot that do not fit in a long anymore are dropped, that only costs precision. An integer part that
+      //does not fit saturates at the largest long.
+      if (!fraction)
+      {
+        if (value < 214748364L || (value == 214748364L && *p <= '7'))
+          value = value * 10 + (*p - '0');
+        else
+          value = 2147483647L;
+      }else if (value < 214748364L && dec < 9)
+      {
+        value = value * 10 + (*p - '0');
+        dec++;
+      }
+    }else if (*p == '.' && !fraction)
+    {
+      fraction = true;
+    }else{
+      break;
+    }
+  }
+  *mantissa = negative ? -value : value;
+  *decimals = dec;
+  return p;
+}
+
+//Tokenize a command line in a single pass. Only the first occurrence of a letter counts, like strchr() did.
+static void parse_command(const char *cmd)
+{
+  const char *p = cmd;
+  uint8_t checksum = 0;
+
+  parsed.cmd = cmd;
+  memset(parsed.pos, PARSED_NONE, sizeof(parsed.pos));
+  parsed.checksum_pos = PARSED_NONE;
+  while(*p)
+  {
+    char c = *p;
+    if (c == '*')
+    {
+      uint8_t dec;
+      parsed.checksum_pos = p - cmd;
+      parse_number(p + 1, &parsed.checksum_value, &dec);
+      parsed.checksum_value /= (long)pgm_read_dword(&pow10_table[dec]);
+      break;
+    }
+    checksum ^= c;
+    p++;
+    if (c >= 'A' && c <= 'Z' && parsed.pos[c - 'A'] == PARSED_NONE)
+    {
+      uint8_t n = c - 'A';
+      parsed.pos[n] = (p - 1) - cmd;
+      parse_number(p, &parsed.mantissa[n], &parsed.decimals[n]);
+    }
+  }
+  parsed.checksum = checksum;
+}
+
+#ifdef BINARY_GCODE
+//Fill the tokenized record straight from a binary move, so moves from binary frames skip parse_command().
+static void parse_binary_move(const binary_gcode_move_t *move)
+{
+  static const char axis_letter[NUM_AXIS] = {'X', 'Y', 'Z', 'E'};
+
+  parsed.cmd = (const char*)move;
+  memset(parsed.pos, PARSED_NONE, sizeof(parsed.pos));
+  parsed.checksum_pos = PARSED_NONE;
+  parsed.pos['G' - 'A'] = 0;
+  parsed.mantissa['G' - 'A'] = (move->flags & BINARY_GCODE_MOVE_G0) ? 0 : 1;
+  parsed.decimals['G' - 'A'] = 0;
+  for(uint8_t axis=0; axis<NUM_AXIS; axis++)
+  {
+    if (move->flags & _BV(axis))
+    {
+      uint8_t n = axis_letter[axis] - 'A';
+      parsed.pos[n] = 0;
+      parsed.mantissa[n] = move->position[axis];
+      parsed.decimals[n] = (axis == E_AXIS) ? 4 : 3;
+    }
+  }
+  if (move->flags & BINARY_GCODE_MOVE_F)
+  {
+    parsed.pos['F' - 'A'] = 0;
+    parsed.mantissa['F' - 'A'] = move->feedrate;
+    parsed.decimals['F' - 'A'] = 0;
+  }
+}
+#endif
+
+float code_value()
+{
+  if (parsed.decimals[code_letter] == 0)
+    return parsed.mantissa[code_letter];
+  return float(parsed.mantissa[code_letter]) / float((long)pgm_read_dword(&pow10_table[parsed.decimals[code_letter]]));
+}
+
+long code_value_long()
+{
+  if (parsed.decimals[code_letter] == 0)
+    return parsed.mantissa[code_letter];
+  return parsed.mantissa[code_letter] / (long)pgm_read_dword(&pow10_table[parsed.decimals[code_letter]]);
+}
+
+bool code_seen(char code)
+{
+  if (code < 'A' || code > 'Z' || parsed.pos[code - 'A'] == PARSED_NONE)
+    return false;
+  code_letter = code - 'A';
+  strchr_pointer = (char*)parsed.cmd + parsed.pos[code_letter];
+  return true;
+}
+
+//Queue the command that was received from the serial port at bufindw, already tokenized by parse_command().
+static void serial_command_received(uint8_t source)
+{
+  bool ok = false;
+  if(code_seen('G')){
+    switch((int)code_value()){
+    case 0:
+    case 1:
+    case 2:
+    case 3:
+      if(Stopped == false) { // If printer is stopped by an error the G[0-3] codes are ignored.
+    #ifdef SDSUPPORT
+        if(card.saving)
+          break;
+    #endif //SDSUPPORT
+        ok = true;
+      }
+      else {
+        SERIAL_ERRORLNPGM(MSG_ERR_STOPPED);
+        LCD_MESSAGEPGM(MSG_STOPPED);
+      }
+      break;
+    default:
+      break;
+    }
+
+  }
+#ifdef ENABLE_ULTILCD2
+  if (!code_seen('M') || code_value_long() != 105)
+      lastSerialCommandTime = millis();
+#endif
+  cmd_queue_commit(source);
+  if (ok)
+    SendOk(); //After queueing, so the free buffer slots of an advanced ok include this command
+}
+
+#ifdef BINARY_GCODE
+static void get_binary_command()
+{
+  while(binary_gcode_mode && MYSERIAL.available() > 0 && cmd_queue_writable()) {
+    switch(binary_gcode_feed(&binary_gcode_serial, MYSERIAL.read(), CMD_TEXT(bufindw)))
+    {
+    case BINARY_GCODE_COMMAND:
+      parse_command(CMD_TEXT(bufindw));
+      serial_command_received(CMD_SOURCE_SERIAL);
+      break;
+    case BINARY_GCODE_RECORD:
+#ifdef SDSUPPORT
+      if (card.saving)
+      {
+        //Commands are written to the file as text.
+        binary_gcode_move_t move = *(binary_gcode_move_t*)CMD_TEXT(bufindw);
+        binary_gcode_move_text(&move, CMD_TEXT(bufindw));
+        parse_command(CMD_TEXT(bufindw));
+        serial_command_received(CMD_SOURCE_SERIAL);
+        break;
+      }
+#endif
+      parse_binary_move((binary_gcode_move_t*)CMD_TEXT(bufindw));
+      serial_command_received(CMD_SOURCE_SERIAL | CMD_SOURCE_MOVE);
+      break;
+    case BINARY_GCODE_RESEND:
+      MYSERIAL.flush();
+      SERIAL_PROTOCOLPGM(MSG_RESEND);
+      SERIAL_PROTOCOLLN((int)binary_gcode_expected_sequence());
+      SendOk();
+      break;
+    case BINARY_GCODE_ACK:
+      SendOk();
+      break;
+    }
+  }
+}
+#endif
+
+#ifdef SDSUPPORT
+static void sd_print_finished()
+{
+  SERIAL_PROTOCOLLNPGM(MSG_FILE_PRINTED);
+  stoptime=millis();
+  char time[30];
+  unsigned long t=(stoptime-starttime)/1000;
+  int hours, minutes;
+  minutes=(t/60)%60;
+  hours=t/60/60;
+  sprintf_P(time, PSTR("%i hours %i minutes"),hours, minutes);
+  SERIAL_ECHO_START;
+  SERIAL_ECHOLN(time);
+  lcd_setstatus(time);
+  card.printingHasFinished();
+  card.checkautostart(true);
+}
+
+#ifdef BINARY_GCODE
+//A frame of the binary print file stays bad. Skipping it would lose a move and put every delta move after it off by that
+//move, so end the print.
+static void sd_binary_file_broken(uint32_t frameStartPosition)
+{
+  SERIAL_ERROR_START;
+  SERIAL_ERRORPGM("Bad binary frame at ");
+  SERIAL_ERRORLN(frameStartPosition);
+  LCD_MESSAGEPGM("Print file damaged");
+  card.printingHasFinished();
+}
+
+//Queue the frames of a binary print file. Moves go into the queue as binary records, so nothing of them is parsed.
+//frameStartPosition is the file position of the frame being read, to read it again after an error.
+static void get_binary_sd_command(uint32_t &frameStartPosition)
+{
+  static uint8_t retries = 0;
+  if (card.getFilePos() == 0)
+    frameStartPosition = 0;
+  while(!card.eof() && cmd_queue_writable()) {
+    int16_t n = card.get();
+    if (card.errorCode())
+    {
+      if (!card.sdInserted)
+      {
+        card.release();
+        return;
+      }
+      //On an error, reset the error and read the frame again.
+      card.clearError();
+      binary_gcode_resync(&binary_gcode_sd);
+      card.setIndex(frameStartPosition);
+      return;
+    }
+    if (n == -1)
+    {
+      sd_print_finished();
+      return;
+    }
+    switch(binary_gcode_feed(&binary_gcode_sd, n, CMD_TEXT(bufindw)))
+    {
+    case BINARY_GCODE_NONE:
+      continue;
+    case BINARY_GCODE_COMMAND:
+      cmd_queue_commit(CMD_SOURCE_SD);
+      break;
+    case BINARY_GCODE_RECORD:
+      cmd_queue_commit(CMD_SOURCE_SD | CMD_SOURCE_MOVE);
+      break;
+    case BINARY_GCODE_ACK:
+      //An exit frame, or a move frame whose flags do not match its length.
+      if (binary_gcode_sd.type == BINARY_GCODE_MOVE)
+      {
+        retries = 0;
+        sd_binary_file_broken(frameStartPosition);
+        return;
+      }
+      break;
+    case BINARY_GCODE_RESEND:
+      //Bad frame. Read it again in case the read went wrong.
+      binary_gcode_resync(&binary_gcode_sd);
+      if (++retries > 3)
+      {
+        retries = 0;
+        sd_binary_file_broken(frameStartPosition);
+        return;
+      }
+      card.setIndex(frameStartPosition);
+      return;
+    }
+    retries = 0;
+    frameStartPosition = card.getFilePos() + 1;
+  }
+  if (card.eof())
+    sd_print_finished();
+}
+#endif
+#endif //SDSUPPORT
+
 void get_command()
 {
-  while( MYSERIAL.available() > 0  && buflen < BUFSIZE) {
+#ifdef BINARY_GCODE
+  if (binary_gcode_mode)
+    get_binary_command();
+  else
+#endif
+  while( MYSERIAL.available() > 0  && cmd_queue_writable()) {
     serial_char = MYSERIAL.read();
     if(serial_char == '\n' ||
        serial_char == '\r' ||
@@ -545,15 +970,14 @@ void get_command()
         comment_mode = false; //for new command
         return;
       }
-      cmdbuffer[bufindw][serial_count] = 0; //terminate string
+      CMD_TEXT(bufindw)[serial_count] = 0; //terminate string
       if(!comment_mode){
         comment_mode = false; //for new command
-        fromsd[bufindw] = false;
-        if(strchr(cmdbuffer[bufindw], 'N') != NULL)
+        parse_command(CMD_TEXT(bufindw));
+        if(code_seen('N'))
         {
-          strchr_pointer = strchr(cmdbuffer[bufindw], 'N');
-          gcode_N = (strtol(&cmdbuffer[bufindw][strchr_pointer - cmdbuffer[bufindw] + 1], NULL, 10));
-          if(gcode_N != gcode_LastN+1 && (strstr_P(cmdbuffer[bufindw], PSTR("M110")) == NULL) ) {
+          gcode_N = code_value_long();
+          if(gcode_N != gcode_LastN+1 && (strstr_P(CMD_TEXT(bufindw), PSTR("M110")) == NULL) ) {
             SERIAL_ERROR_START;
             SERIAL_ERRORPGM(MSG_ERR_LINE_NO);
             SERIAL_ERRORLN(gcode_LastN);
@@ -563,14 +987,9 @@ void get_command()
             return;
           }
 
-          if(strchr(cmdbuffer[bufindw], '*') != NULL)
+          if(parsed.checksum_pos != PARSED_NONE)
           {
-            byte checksum = 0;
-            byte count = 0;
-            while(cmdbuffer[bufindw][count] != '*') checksum = checksum^cmdbuffer[bufindw][count++];
-            strchr_pointer = strchr(cmdbuffer[bufindw], '*');
-
-            if( (int)(strtod(&cmdbuffer[bufindw][strchr_pointer - cmdbuffer[bufindw] + 1], NULL)) != checksum) {
+            if(parsed.checksum_value != parsed.checksum) {
               SERIAL_ERROR_START;
               SERIAL_ERRORPGM(MSG_ERR_CHECKSUM_MISMATCH);
               SERIAL_ERRORLN(gcode_LastN);
@@ -595,7 +1014,7 @@ void get_command()
         }
         else  // if we don't receive 'N' but still see '*'
         {
-          if((strchr(cmdbuffer[bufindw], '*') != NULL))
+          if(parsed.checksum_pos != PARSED_NONE)
           {
             SERIAL_ERROR_START;
             SERIAL_ERRORPGM(MSG_ERR_NO_LINENUMBER_WITH_CHECKSUM);
@@ -604,44 +1023,14 @@ void get_command()
             return;
           }
         }
-        if((strchr(cmdbuffer[bufindw], 'G') != NULL)){
-          strchr_pointer = strchr(cmdbuffer[bufindw], 'G');
-          switch((int)((strtod(&cmdbuffer[bufindw][strchr_pointer - cmdbuffer[bufindw] + 1], NULL)))){
-          case 0:
-          case 1:
-          case 2:
-          case 3:
-            if(Stopped == false) { // If printer is stopped by an error the G[0-3] codes are ignored.
-          #ifdef SDSUPPORT
-              if(card.saving)
-                break;
-          #endif //SDSUPPORT
-              SERIAL_PROTOCOLLNPGM(MSG_OK);
-            }
-            else {
-              SERIAL_ERRORLNPGM(MSG_ERR_STOPPED);
-              LCD_MESSAGEPGM(MSG_STOPPED);
-            }
-            break;
-          default:
-            break;
-          }
-
-        }
-#ifdef ENABLE_ULTILCD2
-        strchr_pointer = strchr(cmdbuffer[bufindw], 'M');
-        if (strtol(&cmdbuffer[bufindw][strchr_pointer - cmdbuffer[bufindw] + 1], NULL, 10) != 105)
-            lastSerialCommandTime = millis();
-#endif
-        bufindw = (bufindw + 1)%BUFSIZE;
-        buflen += 1;
+        serial_command_received(CMD_SOURCE_SERIAL);
       }
       serial_count = 0; //clear buffer
     }
     else
     {
       if(serial_char == ';') comment_mode = true;
-      if(!comment_mode) cmdbuffer[bufindw][serial_count++] = serial_char;
+      if(!comment_mode) CMD_TEXT(bufindw)[serial_count++] = serial_char;
     }
   }
   #ifdef SDSUPPORT
@@ -659,7 +1048,17 @@ void get_command()
     return;
   }
   static uint32_t endOfLineFilePosition = 0;
-  while( !card.eof()  && buflen < BUFSIZE) {
+#ifdef PRINT_CHECKPOINT
+  static uint32_t commandStartPosition = 0;
+#endif
+#ifdef BINARY_GCODE
+  if (card.binaryFile)
+  {
+    get_binary_sd_command(endOfLineFilePosition);
+    return;
+  }
+#endif
+  while( !card.eof()  && cmd_queue_writable()) {
     int16_t n=card.get();
     if (card.errorCode())
     {
@@ -688,31 +1087,23 @@ void get_command()
        serial_count >= (MAX_CMD_SIZE - 1)||n==-1)
     {
       if(card.eof() || n==-1){
-        SERIAL_PROTOCOLLNPGM(MSG_FILE_PRINTED);
-        stoptime=millis();
-        char time[30];
-        unsigned long t=(stoptime-starttime)/1000;
-        int hours, minutes;
-        minutes=(t/60)%60;
-        hours=t/60/60;
-        sprintf_P(time, PSTR("%i hours %i minutes"),hours, minutes);
-        SERIAL_ECHO_START;
-        SERIAL_ECHOLN(time);
-        lcd_setstatus(time);
-        card.printingHasFinished();
-        card.checkautostart(true);
-
+        sd_print_finished();
       }
       if(!serial_count)
       {
         comment_mode = false; //for new command
         return; //if empty line
       }
-      cmdbuffer[bufindw][serial_count] = 0; //terminate string
+      CMD_TEXT(bufindw)[serial_count] = 0; //terminate string
 //      if(!comment_mode){
-        fromsd[bufindw] = true;
-        buflen += 1;
-        bufindw = (bufindw + 1)%BUFSIZE;
+#ifdef PRINT_CHECKPOINT
+      if (print_checkpoint_armed())
+      {
+        print_checkpoint_mark(commandStartPosition);
+        cmd_queue_commit(CMD_SOURCE_SD | CMD_SOURCE_CHECKPOINT);
+      }else
+#endif
+        cmd_queue_commit(CMD_SOURCE_SD);
 //      }
       comment_mode = false; //for new command
       serial_count = 0; //clear buffer
@@ -721,7 +1112,10 @@ void get_command()
     else
     {
       if(serial_char == ';') comment_mode = true;
-      if(!comment_mode) cmdbuffer[bufindw][serial_count++] = serial_char;
+#ifdef PRINT_CHECKPOINT
+      if(!comment_mode && serial_count == 0) commandStartPosition = card.getFilePos();
+#endif
+      if(!comment_mode) CMD_TEXT(bufindw)[serial_count++] = serial_char;
     }
   }
 
@@ -730,22 +1124,6 @@ void get_command()
 }
 
 
-float code_value()
-{
-  return (strtod(&cmdbuffer[bufindr][strchr_pointer - cmdbuffer[bufindr] + 1], NULL));
-}
-
-long code_value_long()
-{
-  return (strtol(&cmdbuffer[bufindr][strchr_pointer - cmdbuffer[bufindr] + 1], NULL, 10));
-}
-
-bool code_seen(char code)
-{
-  strchr_pointer = strchr(cmdbuffer[bufindr], code);
-  return (strchr_pointer != NULL);  //Return True if a character was found
-}
-
 #define DEFINE_PGM_READ_ANY(type, reader)       \
     static inline type pgm_read_any(const type *p)  \
     { return pgm_read_##reader##_near(p); }
@@ -892,6 +1270,16 @@ void process_commands()
   unsigned long codenum; //throw away variable
   char *starpos = NULL;
 
+#ifdef BINARY_GCODE
+  if (CMD_ISMOVE(bufindr))
+    parse_binary_move((binary_gcode_move_t*)CMD_TEXT(bufindr));
+  else
+#endif
+    parse_command(CMD_TEXT(bufindr));
+#ifdef PRINT_CHECKPOINT
+  if (cmdbuffer[bufindr] & CMD_SOURCE_CHECKPOINT)
+    print_checkpoint_snapshot(feedrate);
+#endif
   printing_state = PRINT_STATE_NORMAL;
   if(code_seen('G'))
   {
@@ -1261,7 +1649,7 @@ void process_commands()
     case 28: //M28 - Start SD write
       starpos = (strchr(strchr_pointer + 4,'*'));
       if(starpos != NULL){
-        char* npos = strchr(cmdbuffer[bufindr], 'N');
+        char* npos = strchr(CMD_TEXT(bufindr), 'N');
         strchr_pointer = strchr(npos,' ') + 1;
         *(starpos-1) = '\0';
       }
@@ -1276,7 +1664,7 @@ void process_commands()
         card.closefile();
         starpos = (strchr(strchr_pointer + 4,'*'));
         if(starpos != NULL){
-          char* npos = strchr(cmdbuffer[bufindr], 'N');
+          char* npos = strchr(CMD_TEXT(bufindr), 'N');
           strchr_pointer = strchr(npos,' ') + 1;
           *(starpos-1) = '\0';
         }
@@ -1294,12 +1682,23 @@ void process_commands()
     case 928: //M928 - Start SD write
       starpos = (strchr(strchr_pointer + 5,'*'));
       if(starpos != NULL){
-        char* npos = strchr(cmdbuffer[bufindr], 'N');
+        char* npos = strchr(CMD_TEXT(bufindr), 'N');
         strchr_pointer = strchr(npos,' ') + 1;
         *(starpos-1) = '\0';
       }
       card.openLogFile(strchr_pointer+5);
       break;
+    case 39: //M39 - Report SD cache hits and misses
+      card.getCacheStats();
+      if (code_seen('S') && code_value_long() == 0)
+        card.clearCacheStats();
+      break;
+#if SD_SORT_LIMIT > 0
+    case 34: //M34 - Set SD file listing order
+      if (code_seen('S'))
+        card.setSortMode(code_value_long());
+      break;
+#endif
 
 #endif //SDSUPPORT
 
@@ -1618,6 +2017,9 @@ void process_commands()
       break;
     case 115: // M115
       SERIAL_PROTOCOLPGM(MSG_M115_REPORT);
+      #ifdef ADVANCED_OK
+      SERIAL_PROTOCOLLNPGM("Cap:ADVANCED_OK RX_BUFFER_SIZE:" STRINGIFY(RX_BUFFER_SIZE) " BUFSIZE:" STRINGIFY(BUFSIZE) " BLOCK_BUFFER_SIZE:" STRINGIFY(BLOCK_BUFFER_SIZE));
+      #endif
       break;
     case 117: // M117 display message
       starpos = (strchr(strchr_pointer + 5,'*'));
@@ -1677,6 +2079,14 @@ void process_commands()
         serialprintPGM(((READ(Z_MAX_PIN)^Z_ENDSTOPS_INVERTING)?PSTR(MSG_ENDSTOP_HIT):PSTR(MSG_ENDSTOP_OPEN)));
       #endif
       break;
+    #ifdef TEMP_HISTORY
+    case 155: // M155 - Temperature history
+      if(code_seen('S'))
+        temp_history_stream = code_value() > 0;
+      if(!code_seen('S') || temp_history_stream)
+        temp_history_dump();
+      break;
+    #endif//TEMP_HISTORY
       //TODO: update for all axis, use for loop
     case 201: // M201
       for(int8_t i=0; i < NUM_AXIS; i++)
@@ -1762,7 +2172,7 @@ void process_commands()
           default:
             SERIAL_ECHO_START;
             SERIAL_ECHOPGM(MSG_UNKNOWN_COMMAND);
-            SERIAL_ECHO(cmdbuffer[bufindr]);
+            SERIAL_ECHO(CMD_TEXT(bufindr));
             SERIAL_ECHOLNPGM("\"");
         }
       }
@@ -1876,7 +2286,7 @@ void process_commands()
         if(code_seen('D')) Kd = scalePID_d(code_value());
 
         #ifdef PID_ADD_EXTRUSION_RATE
-        if(code_seen('C')) Kc = code_value();
+        if(code_seen('C')) Kc[active_extruder] = code_value();
         #endif
 
         updatePID();
@@ -1890,7 +2300,7 @@ void process_commands()
         #ifdef PID_ADD_EXTRUSION_RATE
         SERIAL_PROTOCOLPGM(" c:");
         //Kc does not have scaling applied above, or in resetting defaults
-        SERIAL_PROTOCOL(Kc);
+        SERIAL_PROTOCOL(Kc[active_extruder]);
         #endif
         SERIAL_PROTOCOLLN("");
       }
@@ -1949,7 +2359,7 @@ void process_commands()
     {
       float temp = 150.0;
       int e=0;
-      int c=5;
+      int c=10;
       if (code_seen('E')) e=code_value();
         if (e<0)
           temp=70;
@@ -2300,6 +2710,9 @@ void process_commands()
     case 350: // M350 Set microstepping mode. Warning: Steps per unit remains unchanged. S code sets stepping mode for all drivers.
     {
       #if defined(X_MS1_PIN) && X_MS1_PIN > -1
+        #ifdef DYNAMIC_MICROSTEPPING
+        st_synchronize();
+        #endif
         if(code_seen('S')) for(int i=0;i<=4;i++) microstep_mode(i,code_value());
         for(int i=0;i<NUM_AXIS;i++) if(code_seen(axis_codes[i])) microstep_mode(i,(uint8_t)code_value());
         if(code_seen('B')) microstep_mode(4,code_value());
@@ -2310,6 +2723,9 @@ void process_commands()
     case 351: // M351 Toggle MS1 MS2 pins directly, S# determines MS1 or MS2, X# sets the pin high/low.
     {
       #if defined(X_MS1_PIN) && X_MS1_PIN > -1
+      #ifdef DYNAMIC_MICROSTEPPING
+      st_synchronize();
+      #endif
       if(code_seen('S')) switch((int)code_value())
       {
         case 1:
@@ -2325,6 +2741,30 @@ void process_commands()
       #endif
     }
     break;
+    #ifdef DYNAMIC_MICROSTEPPING
+    case 352: // M352 S<1=true/0=false> Enable or disable coarse microstepping for fast travel moves.
+    {
+      if(code_seen('S')) dynamic_microstepping_enabled = code_value() != 0;
+      SERIAL_ECHO_START;
+      SERIAL_ECHOPAIR("Dynamic microstepping:", (unsigned long)dynamic_microstepping_enabled);
+      SERIAL_ECHOLN("");
+    }
+    break;
+    #endif
+    #ifdef PRINT_CHECKPOINT
+    case 413: // M413 Report the print checkpoint, M413 R is queued when resuming a print to move back to it.
+      if(code_seen('R'))
+        feedrate = print_checkpoint_return(feedrate);
+      else
+        print_checkpoint_report();
+    break;
+    #endif
+    #ifdef BINARY_GCODE
+    case 880: // M880 S<sequence> Switch to binary frames, the host starts sending them after the ok of this command.
+      if(!CMD_FROMSD(bufindr))
+        binary_gcode_start(code_seen('S') ? code_value_long() : 0);
+    break;
+    #endif
     case 999: // M999: Restart after being stopped
       Stopped = false;
       lcd_reset_alert_level();
@@ -2341,10 +2781,10 @@ void process_commands()
           if (code_seen('X')) {
             x = code_value_long();
             if (code_seen('Y')) y = code_value_long();
-             if (code_seen('S')) lcd_lib_draw_string(x, y, &cmdbuffer[bufindr][strchr_pointer - cmdbuffer[bufindr] + 1]);
+             if (code_seen('S')) lcd_lib_draw_string(x, y, strchr_pointer + 1);
           } else {
             if (code_seen('Y')) y = code_value_long();
-             if (code_seen('S')) lcd_lib_draw_string_center(y,&cmdbuffer[bufindr][strchr_pointer - cmdbuffer[bufindr] + 1]);
+             if (code_seen('S')) lcd_lib_draw_string_center(y,strchr_pointer + 1);
           }
         }
         break;
@@ -2354,10 +2794,10 @@ void process_commands()
           if (code_seen('X')) {
             x = code_value_long();
             if (code_seen('Y')) y = code_value_long();
-             if (code_seen('S')) lcd_lib_clear_string(x, y, &cmdbuffer[bufindr][strchr_pointer - cmdbuffer[bufindr] + 1]);
+             if (code_seen('S')) lcd_lib_clear_string(x, y, strchr_pointer + 1);
           } else {
             if (code_seen('Y')) y = code_value_long();
-             if (code_seen('S')) lcd_lib_clear_string_center(y, &cmdbuffer[bufindr][strchr_pointer - cmdbuffer[bufindr] + 1]);
+             if (code_seen('S')) lcd_lib_clear_string_center(y, strchr_pointer + 1);
           }
         }
         break;
@@ -2450,7 +2890,7 @@ void process_commands()
       SERIAL_PROTOCOLLN((int)active_extruder);
     }
   }
-  else if (strcmp_P(cmdbuffer[bufindr], PSTR("Electronics_test")) == 0)
+  else if (strcmp_P(CMD_TEXT(bufindr), PSTR("Electronics_test")) == 0)
   {
     run_electronics_test();
   }
@@ -2458,7 +2898,7 @@ void process_commands()
   {
     SERIAL_ECHO_START;
     SERIAL_ECHOPGM(MSG_UNKNOWN_COMMAND);
-    SERIAL_ECHO(cmdbuffer[bufindr]);
+    SERIAL_ECHO(CMD_TEXT(bufindr));
     SERIAL_ECHOLNPGM("\"");
   }
   printing_state = PRINT_STATE_NORMAL;
@@ -2479,10 +2919,32 @@ void ClearToSend()
 {
   previous_millis_cmd = millis();
   #ifdef SDSUPPORT
-  if(fromsd[bufindr])
+  if(CMD_FROMSD(bufindr))
     return;
   #endif //SDSUPPORT
-  SERIAL_PROTOCOLLNPGM(MSG_OK);
+  SendOk();
+}
+
+void SendOk()
+{
+  SERIAL_PROTOCOLPGM(MSG_OK);
+#ifdef ADVANCED_OK
+  SERIAL_PROTOCOLPGM(" N");
+  #ifdef BINARY_GCODE
+  if (binary_gcode_mode)
+  {
+    SERIAL_PROTOCOL((int)(uint8_t)(binary_gcode_expected_sequence() - 1));
+  }else
+  #endif
+  {
+    SERIAL_PROTOCOL(gcode_LastN);
+  }
+  SERIAL_PROTOCOLPGM(" P");
+  SERIAL_PROTOCOL((int)(BLOCK_BUFFER_SIZE - 1 - movesplanned()));
+  SERIAL_PROTOCOLPGM(" B");
+  SERIAL_PROTOCOL(cmd_queue_free());
+#endif
+  MYSERIAL.write('\n');
 }
 
 void get_coordinates()
@@ -2778,9 +3240,15 @@ void kill()
 
 #if defined(PS_ON_PIN) && PS_ON_PIN > -1
   pinMode(PS_ON_PIN,INPUT);
+#endif
+#ifndef AT90USB
+  MYSERIAL.flushTx(); //Interrupts are off, so the transmit buffer has to be sent by hand, before and after the message
 #endif
   SERIAL_ERROR_START;
   SERIAL_ERRORLNPGM(MSG_ERR_KILLED);
+#ifndef AT90USB
+  MYSERIAL.flushTx();
+#endif
   LCD_ALERTMESSAGEPGM(MSG_KILLED);
   suicide();
   while(1) { /* Intentionally left empty */ } // Wait for reset
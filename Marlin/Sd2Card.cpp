@@ -152,11 +152,19 @@ static void spiSend(uint8_t data) {
 //------------------------------------------------------------------------------
 // send command and return error code.  Return zero for OK
 uint8_t Sd2Card::cardCommand(uint8_t cmd, uint32_t arg) {
+#if SD_MULTI_BLOCK_READ
+  // any command ends a multiple block read
+  if (streaming_ && cmd != CMD12) streamStop();
+#endif
+#if SD_MULTI_BLOCK_WRITE
+  // any command ends a multiple block write
+  if (writeStreaming_) writeStreamStop();
+#endif
   // select card
   chipSelectLow();
 
-  // wait up to 300 ms if busy
-  waitNotBusy(300);
+  // wait up to 300 ms if busy, a card sending read data is never idle for stop
+  if (cmd != CMD12) waitNotBusy(300);
 
   // send command
   spiSend(cmd | 0x40);
@@ -285,6 +293,14 @@ bool Sd2Card::eraseSingleBlockEnable() {
  */
 bool Sd2Card::init(uint8_t sckRateID, uint8_t chipSelectPin) {
   errorCode_ = type_ = 0;
+#if SD_MULTI_BLOCK_READ
+  streaming_ = false;
+  nextBlock_ = 0XFFFFFFFF;
+#endif
+#if SD_MULTI_BLOCK_WRITE
+  writeStreaming_ = false;
+  nextWriteBlock_ = 0XFFFFFFFF;
+#endif
   chipSelectPin_ = chipSelectPin;
   // 16-bit init start time allows over a minute
   uint16_t t0 = (uint16_t)millis();
@@ -374,6 +390,22 @@ bool Sd2Card::init(uint8_t sckRateID, uint8_t chipSelectPin) {
  */
 bool Sd2Card::readBlock(uint32_t blockNumber, uint8_t* dst) {
   uint8_t retryCnt = 3;
+#if SD_MULTI_BLOCK_READ
+  if (blockNumber == nextBlock_) {
+    // sequential read, continue or start a multiple block read
+    if (streaming_ || readStart(blockNumber)) {
+      streaming_ = true;
+      if (readData(dst)) {
+        nextBlock_++;
+        return true;
+      }
+      streamStop();
+    }
+    // fall back to a single block read
+    errorCode_ = 0;
+  }
+  nextBlock_ = blockNumber + 1;
+#endif
   // use address if not SDHC card
   if (type()!= SD_CARD_TYPE_SDHC) blockNumber <<= 9;
  retry2:
@@ -495,6 +527,69 @@ bool Sd2Card::readData(uint8_t* dst, uint16_t count) {
   return false;
 }
 //------------------------------------------------------------------------------
+/**
+ * Read part of a 512 byte block from an SD card. The rest of the block is
+ * clocked out without storing it, only to check the CRC.
+ *
+ * \param[in] blockNumber Logical block to be read.
+ * \param[in] offset Offset of the first byte to store.
+ * \param[in] count Number of bytes to store, offset + count <= 512.
+ * \param[out] dst Pointer to the location that will receive the data.
+ * \return The value one, true, is returned for success and
+ * the value zero, false, is returned for failure.
+ */
+bool Sd2Card::readBlockPart(uint32_t blockNumber, uint16_t offset, uint16_t count, uint8_t* dst) {
+  uint8_t retryCnt = 3;
+  uint16_t t0;
+  uint16_t crc;
+  // use address if not SDHC card
+  if (type()!= SD_CARD_TYPE_SDHC) blockNumber <<= 9;
+ retry2:
+  retryCnt --;
+  if (cardCommand(CMD17, blockNumber)) {
+    error(SD_CARD_ERROR_CMD17);
+    goto retry;
+  }
+  // wait for start block token
+  t0 = millis();
+  while ((status_ = spiRec()) == 0XFF) {
+    if (((uint16_t)millis() - t0) > SD_READ_TIMEOUT) {
+      error(SD_CARD_ERROR_READ_TIMEOUT);
+      goto retry;
+    }
+  }
+  if (status_ != DATA_START_BLOCK) {
+    error(SD_CARD_ERROR_READ);
+    goto retry;
+  }
+  crc = 0;
+  for (uint16_t i = 0; i < 512; i++) {
+    uint8_t b = spiRec();
+    if ((uint16_t)(i - offset) < count) dst[i - offset] = b;
+    crc = pgm_read_word(&crctab[(crc >> 8 ^ b) & 0XFF]) ^ (crc << 8);
+  }
+  {
+    uint16_t recvCrc = spiRec() << 8;
+    recvCrc |= spiRec();
+    if (crc != recvCrc) {
+      error(SD_CARD_ERROR_CRC);
+      goto retry;
+    }
+  }
+  chipSelectHigh();
+  return true;
+
+ retry:
+  chipSelectHigh();
+  if (retryCnt > 0) {
+    cardCommand(CMD12, 0);//Try sending a stop command, but ignore the result.
+    chipSelectHigh();
+    errorCode_ = 0;
+    goto retry2;
+  }
+  return false;
+}
+//------------------------------------------------------------------------------
 /** read CID or CSR register */
 bool Sd2Card::readRegister(uint8_t cmd, void* buf) {
   uint8_t* dst = reinterpret_cast<uint8_t*>(buf);
@@ -532,6 +627,18 @@ bool Sd2Card::readStart(uint32_t blockNumber) {
   chipSelectHigh();
   return false;
 }
+#if SD_MULTI_BLOCK_READ
+//------------------------------------------------------------------------------
+/** End the multiple block read opened by readBlock(). Like the stop in the
+ * readBlock() retry path the response is ignored.
+ */
+void Sd2Card::streamStop() {
+  streaming_ = false;
+  nextBlock_ = 0XFFFFFFFF;
+  cardCommand(CMD12, 0);
+  chipSelectHigh();
+}
+#endif
 //------------------------------------------------------------------------------
 /** End a read multiple blocks sequence.
  *
@@ -594,6 +701,22 @@ bool Sd2Card::waitNotBusy(uint16_t timeoutMillis) {
  * the value zero, false, is returned for failure.
  */
 bool Sd2Card::writeBlock(uint32_t blockNumber, const uint8_t* src) {
+#if SD_MULTI_BLOCK_WRITE
+  if (blockNumber == nextWriteBlock_) {
+    // sequential write, continue or start a multiple block write
+    if (writeStreaming_ || writeStart(blockNumber, 1)) {
+      writeStreaming_ = true;
+      if (writeData(src)) {
+        nextWriteBlock_++;
+        return true;
+      }
+      writeStreamStop();
+    }
+    // fall back to a single block write
+    errorCode_ = 0;
+  }
+  nextWriteBlock_ = blockNumber + 1;
+#endif
   // use address if not SDHC card
   if (type() != SD_CARD_TYPE_SDHC) blockNumber <<= 9;
   if (cardCommand(CMD24, blockNumber)) {
@@ -619,6 +742,15 @@ bool Sd2Card::writeBlock(uint32_t blockNumber, const uint8_t* src) {
   chipSelectHigh();
   return false;
 }
+#if SD_MULTI_BLOCK_WRITE
+//------------------------------------------------------------------------------
+/** End the multiple block write opened by writeBlock(). */
+void Sd2Card::writeStreamStop() {
+  writeStreaming_ = false;
+  nextWriteBlock_ = 0XFFFFFFFF;
+  writeStop();
+}
+#endif
 //------------------------------------------------------------------------------
 /** Write one data block in a multiple block write sequence
  * \param[in] src Pointer to the location of the data to be written.
@@ -156,7 +156,14 @@ uint8_t const SPI_SCK_PIN = SOFT_SPI_SCK_PIN;
 class Sd2Card {
  public:
   /** Construct an instance of Sd2Card. */
-  Sd2Card() : errorCode_(SD_CARD_ERROR_INIT_NOT_CALLED), type_(0) {}
+  Sd2Card() : errorCode_(SD_CARD_ERROR_INIT_NOT_CALLED), type_(0)
+#if SD_MULTI_BLOCK_READ
+    , streaming_(false), nextBlock_(0XFFFFFFFF)
+#endif
+#if SD_MULTI_BLOCK_WRITE
+    , writeStreaming_(false), nextWriteBlock_(0XFFFFFFFF)
+#endif
+    {}
   uint32_t cardSize();
   bool erase(uint32_t firstBlock, uint32_t lastBlock);
   bool eraseSingleBlockEnable();
@@ -180,6 +187,7 @@ class Sd2Card {
   bool init(uint8_t sckRateID = SPI_FULL_SPEED,
     uint8_t chipSelectPin = SD_CHIP_SELECT_PIN);
   bool readBlock(uint32_t block, uint8_t* dst);
+  bool readBlockPart(uint32_t block, uint16_t offset, uint16_t count, uint8_t* dst);
   /**
    * Read a card's CID register. The CID contains card identification
    * information such as Manufacturer ID, Product name, Product serial
@@ -222,6 +230,16 @@ class Sd2Card {
   uint8_t spiRate_;
   uint8_t status_;
   uint8_t type_;
+#if SD_MULTI_BLOCK_READ
+  bool streaming_;      // a CMD18 multiple block read is open
+  uint32_t nextBlock_;  // block following the last block read
+  void streamStop();
+#endif
+#if SD_MULTI_BLOCK_WRITE
+  bool writeStreaming_;      // a CMD25 multiple block write is open
+  uint32_t nextWriteBlock_;  // block following the last block written
+  void writeStreamStop();
+#endif
   // private functions
   uint8_t cardAcmd(uint8_t cmd, uint32_t arg) {
     cardCommand(CMD55, 0);
@@ -27,6 +27,12 @@
 SdBaseFile* SdBaseFile::cwd_ = 0;
 // callback function for date/time
 void (*SdBaseFile::dateTime_)(uint16_t* date, uint16_t* time) = 0;
+#if SD_MAX_EXTENTS > 0
+// run list of the file mapped by mapExtents()
+const SdBaseFile* SdBaseFile::extentFile_ = 0;
+uint8_t SdBaseFile::extentCount_ = 0;
+SdBaseFile::extent_t SdBaseFile::extent_[SD_MAX_EXTENTS];
+#endif
 //------------------------------------------------------------------------------
 // add a cluster to a file
 bool SdBaseFile::addCluster() {
@@ -93,6 +99,9 @@ dir_t* SdBaseFile::cacheDirEntry(uint8_t action) {
 bool SdBaseFile::close() {
   bool rtn = sync();
   type_ = FAT_FILE_TYPE_CLOSED;
+#if SD_MAX_EXTENTS > 0
+  if (extentFile_ == this) extentFile_ = 0;
+#endif
   return rtn;
 }
 //------------------------------------------------------------------------------
@@ -129,6 +138,83 @@ bool SdBaseFile::contiguousRange(uint32_t* bgnBlock, uint32_t* endBlock) {
   return false;
 }
 //------------------------------------------------------------------------------
+#if SD_MAX_EXTENTS > 0
+/** Map the cluster runs of a file that is open read only, so read() and
+ * seekSet() can find the next cluster without reading the FAT. Only one
+ * file is mapped at a time, mapping a file drops the previous map.
+ *
+ * A file with more than SD_MAX_EXTENTS runs is mapped up to the last run
+ * that fits, clusters behind it are still found in the FAT.
+ *
+ * \return The value one, true, is returned if the whole file is mapped
+ * and the value zero, false, if it is mapped partly or not at all.
+ * Reasons for not mapping include the file is a directory, open for write
+ * or empty, or an I/O error occurred.
+ */
+bool SdBaseFile::mapExtents() {
+  uint32_t c = firstCluster_;
+  uint32_t clusters;
+  uint8_t n = 1;
+
+  extentFile_ = 0;
+  if (!isFile() || (flags_ & O_WRITE) || c == 0 || fileSize_ == 0) goto fail;
+
+  // only follow the chain as far as the file size needs
+  clusters = ((fileSize_ - 1) >> (vol_->clusterSizeShift_ + 9)) + 1;
+  extent_[0].firstCluster = c;
+  extent_[0].clusterCount = 1;
+  while (--clusters) {
+    uint32_t next;
+    if (!vol_->fatGet(c, &next)) goto fail;
+    if (next == c + 1) {
+      extent_[n - 1].clusterCount++;
+    } else {
+      if (n == SD_MAX_EXTENTS) break;
+      extent_[n].firstCluster = next;
+      extent_[n].clusterCount = 1;
+      n++;
+    }
+    c = next;
+  }
+  extentCount_ = n;
+  extentFile_ = this;
+  return clusters == 0;
+
+ fail:
+  return false;
+}
+//------------------------------------------------------------------------------
+// find the cluster following cluster in the extent map, false if this file
+// is not mapped or the cluster is behind the map
+bool SdBaseFile::extentNext(uint32_t* cluster) {
+  if (extentFile_ != this) return false;
+  for (uint8_t i = 0; i < extentCount_; i++) {
+    uint32_t offset = *cluster - extent_[i].firstCluster;
+    if (offset < extent_[i].clusterCount) {
+      if (offset + 1 < extent_[i].clusterCount) {
+        (*cluster)++;
+        return true;
+      }
+      if (i + 1 < extentCount_) {
+        *cluster = extent_[i + 1].firstCluster;
+        return true;
+      }
+      break;
+    }
+  }
+  return false;
+}
+#endif
+//------------------------------------------------------------------------------
+// find the cluster following cluster while reading, from the extent map or
+// the FAT entry cache, so the block cache keeps the data block
+bool SdBaseFile::nextCluster(uint32_t* cluster) {
+#if SD_MAX_EXTENTS > 0
+  if (extentNext(cluster)) return true;
+#endif
+  return vol_->fatGetCached(*cluster, cluster);
+}
+//------------------------------------------------------------------------------
 /** Create and open a new contiguous file of a specified size.
  *
  * \note This function only supports short DOS 8.3 names.
@@ -172,6 +258,50 @@ bool SdBaseFile::createContiguous(SdBaseFile* dirFile,
   return false;
 }
 //------------------------------------------------------------------------------
+/** Reserve clusters for data that will be appended to a file.
+ *
+ * A contiguous group of clusters large enough for \a size bytes is linked
+ * after the last cluster of the file, so later writes follow the chain
+ * instead of allocating and linking one cluster at a time. Clusters that
+ * are not written to can be returned with truncate(fileSize()).
+ *
+ * \param[in] size The number of bytes to reserve.
+ *
+ * \return The value one, true, is returned for success and
+ * the value zero, false, is returned for failure.
+ * Reasons for failure include the file is not open for write, there is
+ * no free contiguous group of clusters large enough or an I/O error.
+ */
+bool SdBaseFile::preallocate(uint32_t size) {
+  uint32_t count;
+  uint32_t last;
+  // error if not a normal file or read-only
+  if (!isFile() || !(flags_ & O_WRITE) || size == 0) goto fail;
+
+  // calculate number of clusters needed
+  count = ((size - 1) >> (vol_->clusterSizeShift_ + 9)) + 1;
+
+  if (firstCluster_ == 0) {
+    if (!vol_->allocContiguous(count, &firstCluster_)) goto fail;
+
+    // insure sync() will update dir entry
+    flags_ |= F_FILE_DIR_DIRTY;
+    return true;
+  }
+  // find the end of the chain, usually the current cluster
+  last = curCluster_ ? curCluster_ : firstCluster_;
+  while (1) {
+    uint32_t next;
+    if (!vol_->fatGetCached(last, &next)) goto fail;
+    if (vol_->isEOC(next)) break;
+    last = next;
+  }
+  return vol_->allocContiguous(count, &last);
+
+ fail:
+  return false;
+}
+//------------------------------------------------------------------------------
 /** Return a file's directory entry.
  *
  * \param[out] dir Location for return of the file's directory entry.
@@ -741,6 +871,11 @@ bool SdBaseFile::openCachedEntry(uint8_t dirIndex, uint8_t oflag) {
   // location of entry in cache
   dir_t* p = &vol_->cache()->dir[dirIndex];
 
+#if SD_MAX_EXTENTS > 0
+  // a map left behind by this object belongs to another file
+  if (extentFile_ == this) extentFile_ = 0;
+#endif
+
   // write or truncate is an error for a directory or read-only file
   if (p->attributes & (DIR_ATT_READ_ONLY | DIR_ATT_DIRECTORY)) {
     if (oflag & (O_WRITE | O_TRUNC)) goto fail;
@@ -1068,8 +1203,8 @@ int16_t SdBaseFile::read(void* buf, uint16_t nbyte) {
           // use first cluster in file
           curCluster_ = firstCluster_;
         } else {
-          // get next cluster from FAT
-          if (!vol_->fatGet(curCluster_, &curCluster_)) goto fail;
+          // get next cluster from the extent map or FAT
+          if (!nextCluster(&curCluster_)) goto fail;
         }
       }
       block = vol_->clusterStartBlock(curCluster_) + blockOfCluster;
@@ -1481,6 +1616,9 @@ bool SdBaseFile::seekSet(uint32_t pos) {
     nNew -= nCur;
   }
   while (nNew--) {
+#if SD_MAX_EXTENTS > 0
+    if (extentNext(&curCluster_)) continue;
+#endif
     if (!vol_->fatGet(curCluster_, &curCluster_)) goto fail;
   }
   curPosition_ = pos;
@@ -1672,8 +1810,8 @@ bool SdBaseFile::truncate(uint32_t length) {
   // error if length is greater than current size
   if (length > fileSize_) goto fail;
 
-  // fileSize and length are zero - nothing to do
-  if (fileSize_ == 0) return true;
+  // fileSize and length are zero and no clusters are reserved - nothing to do
+  if (fileSize_ == 0 && firstCluster_ == 0) return true;
 
   // remember position for seek after truncation
   newPos = curPosition_ > length ? length : curPosition_;
@@ -1755,7 +1893,7 @@ int16_t SdBaseFile::write(const void* buf, uint16_t nbyte) {
         }
       } else {
         uint32_t next;
-        if (!vol_->fatGet(curCluster_, &next)) goto fail;
+        if (!vol_->fatGetCached(curCluster_, &next)) goto fail;
         if (vol_->isEOC(next)) {
           // add cluster if at end of chain
           if (!addCluster()) goto fail;
@@ -206,6 +206,10 @@ class SdBaseFile {
   bool contiguousRange(uint32_t* bgnBlock, uint32_t* endBlock);
   bool createContiguous(SdBaseFile* dirFile,
           const char* path, uint32_t size);
+  bool preallocate(uint32_t size);
+#if SD_MAX_EXTENTS > 0
+  bool mapExtents();
+#endif
   /** \return The current cluster number for a file or directory. */
   uint32_t curCluster() const {return curCluster_;}
   /** \return The current position for a file or directory. */
@@ -345,6 +349,16 @@ class SdBaseFile {
   uint32_t  fileSize_;      // file size in bytes
   uint32_t  firstCluster_;  // first cluster of file
   SdVolume* vol_;           // volume where file is located
+#if SD_MAX_EXTENTS > 0
+  // cluster runs of the one file mapped by mapExtents()
+  struct extent_t {
+    uint32_t firstCluster;
+    uint32_t clusterCount;
+  };
+  static const SdBaseFile* extentFile_;
+  static uint8_t extentCount_;
+  static extent_t extent_[SD_MAX_EXTENTS];
+#endif
 
   /** experimental don't use */
   bool openParent(SdBaseFile* dir);
@@ -357,6 +371,10 @@ class SdBaseFile {
   bool mkdir(SdBaseFile* parent, const uint8_t dname[11]);
   bool open(SdBaseFile* dirFile, const uint8_t dname[11], uint8_t oflag);
   bool openCachedEntry(uint8_t cacheIndex, uint8_t oflags);
+#if SD_MAX_EXTENTS > 0
+  bool extentNext(uint32_t* cluster);
+#endif
+  bool nextCluster(uint32_t* cluster);
   dir_t* readDirCache();
 //------------------------------------------------------------------------------
 // to be deleted
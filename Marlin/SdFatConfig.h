@@ -73,6 +73,55 @@
  */
 #define SPI_SD_INIT_RATE 5
 //------------------------------------------------------------------------------
+/**
+ * Read sequential blocks with one multiple block read (CMD18) if
+ * SD_MULTI_BLOCK_READ is nonzero.
+ *
+ * When a block is read right after the block in front of it, Sd2Card keeps
+ * the card streaming and following sequential blocks cost only the data
+ * transfer instead of a command, response and card access delay each. Any
+ * other command, like a read elsewhere or a write, stops the stream first.
+ */
+#define SD_MULTI_BLOCK_READ 1
+//------------------------------------------------------------------------------
+/**
+ * Write sequential blocks with one multiple block write (CMD25) if
+ * SD_MULTI_BLOCK_WRITE is nonzero.
+ *
+ * When a block is written right after the block in front of it, Sd2Card
+ * keeps the write open and following sequential blocks are sent without a
+ * command and the CMD13 status check of a single block write. No blocks are
+ * pre-erased, so blocks past the last one written are never touched. Any
+ * other command stops the write first.
+ */
+#define SD_MULTI_BLOCK_WRITE 1
+//------------------------------------------------------------------------------
+/**
+ * Number of cluster runs (extents) SdBaseFile::mapExtents() can hold.
+ *
+ * The print file is mapped when printing starts, so read() and seekSet()
+ * find the next cluster of the file with arithmetic instead of a FAT
+ * lookup that also evicts the data block from the single block cache.
+ * A file with more runs is mapped up to the last run that fits, the rest
+ * of it still follows the FAT. Each extent costs 8 bytes of SRAM.
+ * Set to zero to disable.
+ */
+#define SD_MAX_EXTENTS 4
+//------------------------------------------------------------------------------
+/**
+ * FAT entry cache used when reading files and directories.
+ *
+ * SD_FAT_CACHE_ENTRIES pieces of SD_FAT_CACHE_SEGMENT bytes of the FAT are
+ * kept apart from the single 512 byte block cache and replaced least
+ * recently used first, so finding the next cluster of a file does not evict
+ * the cached data or directory block. A miss reads only the needed piece of
+ * the FAT block. Allocation and other FAT scans keep using the block cache.
+ * Costs about SD_FAT_CACHE_ENTRIES * (SD_FAT_CACHE_SEGMENT + 7) bytes of
+ * SRAM. Set SD_FAT_CACHE_ENTRIES to zero to disable.
+ */
+#define SD_FAT_CACHE_ENTRIES 4
+#define SD_FAT_CACHE_SEGMENT 32
+//------------------------------------------------------------------------------
 /**
  * Set the SS pin high for hardware SPI.  If SS is chip select for another SPI
  * device this will disable that device during the SD init phase.
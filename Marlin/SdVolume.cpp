@@ -30,6 +30,15 @@ Sd2Card* SdVolume::sdCard_;            // pointer to SD card object
 bool     SdVolume::cacheDirty_;        // cacheFlush() will write block if true
 uint32_t SdVolume::cacheMirrorBlock_;  // mirror  block for second FAT
 #endif  // USE_MULTIPLE_CARDS
+// cache statistics
+uint32_t SdVolume::cacheHits_;
+uint32_t SdVolume::cacheMisses_;
+uint32_t SdVolume::fatCacheHits_;
+uint32_t SdVolume::fatCacheMisses_;
+#if SD_FAT_CACHE_ENTRIES > 0
+// FAT entry cache
+SdVolume::fatCache_t SdVolume::fatCache_[SD_FAT_CACHE_ENTRIES];
+#endif  // SD_FAT_CACHE_ENTRIES
 //------------------------------------------------------------------------------
 // find a contiguous group of clusters
 bool SdVolume::allocContiguous(uint32_t count, uint32_t* curCluster) {
@@ -126,9 +135,12 @@ bool SdVolume::cacheFlush() {
 //------------------------------------------------------------------------------
 bool SdVolume::cacheRawBlock(uint32_t blockNumber, bool dirty) {
   if (cacheBlockNumber_ != blockNumber) {
+    cacheMisses_++;
     if (!cacheFlush()) goto fail;
     if (!sdCard_->readBlock(blockNumber, cacheBuffer_.data)) goto fail;
     cacheBlockNumber_ = blockNumber;
+  } else {
+    cacheHits_++;
   }
   if (dirty) cacheDirty_ = true;
   return true;
@@ -194,6 +206,77 @@ bool SdVolume::fatGet(uint32_t cluster, uint32_t* value) {
 }
 //------------------------------------------------------------------------------
 // Store a FAT entry
+// get a FAT entry like fatGet() while reading files, without replacing the
+// block in the block cache unless the FAT block already is in it
+bool SdVolume::fatGetCached(uint32_t cluster, uint32_t* value) {
+#if SD_FAT_CACHE_ENTRIES > 0
+  uint32_t lba;
+  uint8_t* p;
+  if (cluster > (clusterCount_ + 1)) goto fail;
+  if (fatType_ == 16) {
+    lba = fatStartBlock_ + (cluster >> 8);
+  } else if (fatType_ == 32) {
+    lba = fatStartBlock_ + (cluster >> 7);
+  } else {
+    return fatGet(cluster, value);
+  }
+  // the block cache may hold a newer copy of the block
+  if (lba == cacheBlockNumber_) return fatGet(cluster, value);
+  if (fatType_ == 16) {
+    p = fatCacheGet(lba, (cluster & 0XFF) << 1);
+    if (!p) goto fail;
+    *value = *reinterpret_cast<uint16_t*>(p);
+  } else {
+    p = fatCacheGet(lba, (cluster & 0X7F) << 2);
+    if (!p) goto fail;
+    *value = *reinterpret_cast<uint32_t*>(p) & FAT32MASK;
+  }
+  return true;
+
+ fail:
+  return false;
+#else  // SD_FAT_CACHE_ENTRIES
+  return fatGet(cluster, value);
+#endif  // SD_FAT_CACHE_ENTRIES
+}
+//------------------------------------------------------------------------------
+#if SD_FAT_CACHE_ENTRIES > 0
+// return a pointer to byte offset of FAT block block in the FAT entry cache,
+// reading the SD_FAT_CACHE_SEGMENT bytes around it into the least recently
+// used entry on a miss
+uint8_t* SdVolume::fatCacheGet(uint32_t block, uint16_t offset) {
+  uint16_t segment = offset & ~(SD_FAT_CACHE_SEGMENT - 1);
+  fatCache_t* e = 0;
+  uint8_t i;
+  for (i = 0; i < SD_FAT_CACHE_ENTRIES; i++) {
+    if (fatCache_[i].block == block && fatCache_[i].offset == segment) {
+      e = &fatCache_[i];
+      fatCacheHits_++;
+      break;
+    }
+  }
+  if (!e) {
+    fatCacheMisses_++;
+    for (i = 0; i < SD_FAT_CACHE_ENTRIES - 1; i++) {
+      if (fatCache_[i].age == SD_FAT_CACHE_ENTRIES - 1) break;
+    }
+    e = &fatCache_[i];
+    if (!sdCard_->readBlockPart(block, segment, SD_FAT_CACHE_SEGMENT, e->data)) {
+      e->block = 0XFFFFFFFF;
+      return 0;
+    }
+    e->block = block;
+    e->offset = segment;
+  }
+  // make e the most recently used entry
+  for (i = 0; i < SD_FAT_CACHE_ENTRIES; i++) {
+    if (fatCache_[i].age < e->age) fatCache_[i].age++;
+  }
+  e->age = 0;
+  return e->data + (offset - segment);
+}
+#endif  // SD_FAT_CACHE_ENTRIES
+//------------------------------------------------------------------------------
 bool SdVolume::fatPut(uint32_t cluster, uint32_t value) {
   uint32_t lba;
   // error if reserved cluster
@@ -238,6 +321,12 @@ bool SdVolume::fatPut(uint32_t cluster, uint32_t value) {
     goto fail;
   }
   if (!cacheRawBlock(lba, CACHE_FOR_WRITE)) goto fail;
+#if SD_FAT_CACHE_ENTRIES > 0
+  // the FAT entry cache copy of this block is out of date now
+  for (uint8_t i = 0; i < SD_FAT_CACHE_ENTRIES; i++) {
+    if (fatCache_[i].block == lba) fatCache_[i].block = 0XFFFFFFFF;
+  }
+#endif  // SD_FAT_CACHE_ENTRIES
   // store entry
   if (fatType_ == 16) {
     cacheBuffer_.fat16[cluster & 0XFF] = value;
@@ -333,6 +422,12 @@ bool SdVolume::init(Sd2Card* dev, uint8_t part) {
   cacheDirty_ = 0;  // cacheFlush() will write block if true
   cacheMirrorBlock_ = 0;
   cacheBlockNumber_ = 0XFFFFFFFF;
+#if SD_FAT_CACHE_ENTRIES > 0
+  for (uint8_t i = 0; i < SD_FAT_CACHE_ENTRIES; i++) {
+    fatCache_[i].block = 0XFFFFFFFF;
+    fatCache_[i].age = i;
+  }
+#endif  // SD_FAT_CACHE_ENTRIES
 
   // if part == 0 assume super floppy with FAT boot sector in block zero
   // if part > 0 assume mbr volume with partition table
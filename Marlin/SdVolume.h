@@ -117,6 +117,18 @@ class SdVolume {
    * \return true for success or false for failure
    */
   bool dbgFat(uint32_t n, uint32_t* v) {return fatGet(n, v);}
+  /** \return Reads served from the block cache since cacheStatsClear(). */
+  static uint32_t cacheHits() {return cacheHits_;}
+  /** \return Blocks read into the block cache since cacheStatsClear(). */
+  static uint32_t cacheMisses() {return cacheMisses_;}
+  /** \return FAT lookups served from the FAT entry cache. */
+  static uint32_t fatCacheHits() {return fatCacheHits_;}
+  /** \return FAT lookups that read the FAT from the card. */
+  static uint32_t fatCacheMisses() {return fatCacheMisses_;}
+  /** Reset the cache hit and miss counters. */
+  static void cacheStatsClear() {
+    cacheHits_ = cacheMisses_ = fatCacheHits_ = fatCacheMisses_ = 0;
+  }
 //------------------------------------------------------------------------------
  private:
   // Allow SdBaseFile access to SdVolume private data.
@@ -140,6 +152,23 @@ class SdVolume {
   static bool cacheDirty_;            // cacheFlush() will write block if true
   static uint32_t cacheMirrorBlock_;  // block number for mirror FAT
 #endif  // USE_MULTIPLE_CARDS
+  static uint32_t cacheHits_;         // block cache statistics, see cacheHits()
+  static uint32_t cacheMisses_;
+  static uint32_t fatCacheHits_;
+  static uint32_t fatCacheMisses_;
+#if SD_FAT_CACHE_ENTRIES > 0
+#if USE_MULTIPLE_CARDS
+#error SD_FAT_CACHE_ENTRIES is not supported with USE_MULTIPLE_CARDS
+#endif  // USE_MULTIPLE_CARDS
+  // piece of a FAT block in the FAT entry cache
+  struct fatCache_t {
+    uint32_t block;                      // FAT block, 0XFFFFFFFF if unused
+    uint16_t offset;                     // offset of data[0] in the block
+    uint8_t age;                         // LRU order, 0 is most recently used
+    uint8_t data[SD_FAT_CACHE_SEGMENT];
+  };
+  static fatCache_t fatCache_[SD_FAT_CACHE_ENTRIES];
+#endif  // SD_FAT_CACHE_ENTRIES
   uint32_t allocSearchStart_;   // start cluster for alloc search
   uint8_t blocksPerCluster_;    // cluster size in blocks
   uint32_t blocksPerFat_;       // FAT size in blocks
@@ -176,6 +205,10 @@ class SdVolume {
   void cacheSetDirty() {cacheDirty_ |= CACHE_FOR_WRITE;}
   bool chainSize(uint32_t beginCluster, uint32_t* size);
   bool fatGet(uint32_t cluster, uint32_t* value);
+  bool fatGetCached(uint32_t cluster, uint32_t* value);
+#if SD_FAT_CACHE_ENTRIES > 0
+  uint8_t* fatCacheGet(uint32_t block, uint16_t offset);
+#endif  // SD_FAT_CACHE_ENTRIES
   bool fatPut(uint32_t cluster, uint32_t value);
   bool fatPutEOC(uint32_t cluster) {
     return fatPut(cluster, 0x0FFFFFFF);
@@ -10,6 +10,7 @@
 #include "cardreader.h"
 #include "ConfigurationStore.h"
 #include "temperature.h"
+#include "print_checkpoint.h"
 #include "pins.h"
 
 #define SERIAL_CONTROL_TIMEOUT 5000
@@ -85,6 +86,11 @@ void lcd_update()
             lcd_lib_draw_stringP(1, 40, PSTR("Go to:"));
             lcd_lib_draw_stringP(1, 50, PSTR("ultimaker.com/ER03"));
             break;
+        case STOP_REASON_HEATER_RUNAWAY:
+            lcd_lib_draw_string_centerP(20, PSTR("Heater runaway"));
+            lcd_lib_draw_stringP(1, 40, PSTR("Heats without power,"));
+            lcd_lib_draw_stringP(1, 50, PSTR("switch off printer"));
+            break;
         case STOP_REASON_SAFETY_TRIGGER:
             lcd_lib_draw_string_centerP(20, PSTR("Safety circuit"));
             lcd_lib_draw_stringP(1, 40, PSTR("Go to:"));
@@ -188,6 +194,11 @@ void lcd_menu_startup()
         if (!IS_FIRST_RUN_DONE())
         {
             currentMenu = lcd_menu_first_run_init;
+#ifdef PRINT_CHECKPOINT
+        }else if (print_checkpoint_available())
+        {
+            currentMenu = lcd_menu_print_resume;
+#endif
         }else{
             currentMenu = lcd_menu_main;
         }
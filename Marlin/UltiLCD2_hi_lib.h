@@ -126,5 +126,11 @@ extern uint8_t led_glow_dir;
 #define USE_CHANGE_TEMPERATURE_MENU_OFFSET 0
 #endif
 
+#ifdef PID_ADD_EXTRUSION_RATE
+#define FEED_FORWARD_MENU_OFFSET 1
+#else
+#define FEED_FORWARD_MENU_OFFSET 0
+#endif
+
 
 #endif//ULTI_LCD2_HI_LIB_H
@@ -500,6 +500,13 @@ static void lcd_menu_material_export()
         float_to_string(eeprom_read_byte(EEPROM_MATERIAL_CHANGE_WAIT_TIME(n)), ptr, PSTR("\n\n"));
         card.write_string(buffer);
 #endif
+
+#ifdef PID_ADD_EXTRUSION_RATE
+        strcpy_P(buffer, PSTR("feed_forward="));
+        ptr = buffer + strlen(buffer);
+        int_to_string(eeprom_read_byte(EEPROM_MATERIAL_FEED_FORWARD(n)), ptr, PSTR("\n"));
+        card.write_string(buffer);
+#endif
     }
     card.closefile();
 
@@ -590,6 +597,11 @@ static void lcd_menu_material_import()
                 }else if (strcmp_P(buffer, PSTR("change_wait")) == 0)
                 {
                     eeprom_write_byte(EEPROM_MATERIAL_CHANGE_WAIT_TIME(count), strtol(c, NULL, 10));
+#endif
+#ifdef PID_ADD_EXTRUSION_RATE
+                }else if (strcmp_P(buffer, PSTR("feed_forward")) == 0)
+                {
+                    eeprom_write_byte(EEPROM_MATERIAL_FEED_FORWARD(count), strtol(c, NULL, 10));
 #endif
                 }
                 for(uint8_t nozzle=0; nozzle<MATERIAL_NOZZLE_COUNT; nozzle++)
@@ -754,9 +766,13 @@ static char* lcd_material_settings_callback(uint8_t nr)
     else if (nr == 6 + BED_MENU_OFFSET)
         strcpy_P(card.longFilename, PSTR("Change wait time"));
 #endif
+#ifdef PID_ADD_EXTRUSION_RATE
     else if (nr == 5 + USE_CHANGE_TEMPERATURE_MENU_OFFSET + BED_MENU_OFFSET)
+        strcpy_P(card.longFilename, PSTR("Heater feed forward"));
+#endif
+    else if (nr == 5 + FEED_FORWARD_MENU_OFFSET + USE_CHANGE_TEMPERATURE_MENU_OFFSET + BED_MENU_OFFSET)
         strcpy_P(card.longFilename, PSTR("Retraction"));
-    else if (nr == 6 + USE_CHANGE_TEMPERATURE_MENU_OFFSET + BED_MENU_OFFSET)
+    else if (nr == 6 + FEED_FORWARD_MENU_OFFSET + USE_CHANGE_TEMPERATURE_MENU_OFFSET + BED_MENU_OFFSET)
         strcpy_P(card.longFilename, PSTR("Store as preset"));
     else
         strcpy_P(card.longFilename, PSTR("???"));
@@ -803,6 +819,11 @@ static void lcd_material_settings_details_callback(uint8_t nr)
     }else if (nr == 6 + BED_MENU_OFFSET)
     {
         int_to_string(material[active_extruder].change_preheat_wait_time, buffer, PSTR("Sec"));
+#endif
+#ifdef PID_ADD_EXTRUSION_RATE
+    }else if (nr == 5 + USE_CHANGE_TEMPERATURE_MENU_OFFSET + BED_MENU_OFFSET)
+    {
+        int_to_string(material[active_extruder].feed_forward, buffer, PSTR(" per mm/s"));
 #endif
     }
     lcd_lib_draw_string(5, 53, buffer);
@@ -810,7 +831,7 @@ static void lcd_material_settings_details_callback(uint8_t nr)
 
 static void lcd_menu_material_settings()
 {
-    lcd_scroll_menu(PSTR("MATERIAL"), 7 + USE_CHANGE_TEMPERATURE_MENU_OFFSET + BED_MENU_OFFSET, lcd_material_settings_callback, lcd_material_settings_details_callback);
+    lcd_scroll_menu(PSTR("MATERIAL"), 7 + FEED_FORWARD_MENU_OFFSET + USE_CHANGE_TEMPERATURE_MENU_OFFSET + BED_MENU_OFFSET, lcd_material_settings_callback, lcd_material_settings_details_callback);
     if (lcd_lib_button_pressed)
     {
         if (IS_SELECTED_SCROLL(0))
@@ -838,9 +859,13 @@ static void lcd_menu_material_settings()
         else if (IS_SELECTED_SCROLL(6 + BED_MENU_OFFSET))
             LCD_EDIT_SETTING(material[active_extruder].change_preheat_wait_time, "Change wait time", "sec", 0, 180);
 #endif
+#ifdef PID_ADD_EXTRUSION_RATE
         else if (IS_SELECTED_SCROLL(5 + USE_CHANGE_TEMPERATURE_MENU_OFFSET + BED_MENU_OFFSET))
+            LCD_EDIT_SETTING(material[active_extruder].feed_forward, "Heater feed forward", " per mm/s", 0, MATERIAL_FEED_FORWARD_MAX);
+#endif
+        else if (IS_SELECTED_SCROLL(5 + FEED_FORWARD_MENU_OFFSET + USE_CHANGE_TEMPERATURE_MENU_OFFSET + BED_MENU_OFFSET))
             lcd_change_to_menu(lcd_menu_material_retraction_settings);
-        else if (IS_SELECTED_SCROLL(6 + USE_CHANGE_TEMPERATURE_MENU_OFFSET + BED_MENU_OFFSET))
+        else if (IS_SELECTED_SCROLL(6 + FEED_FORWARD_MENU_OFFSET + USE_CHANGE_TEMPERATURE_MENU_OFFSET + BED_MENU_OFFSET))
             lcd_change_to_menu(lcd_menu_material_settings_store);
     }
 }
@@ -1041,6 +1066,9 @@ void lcd_material_reset_defaults()
 
     eeprom_write_word(EEPROM_MATERIAL_CHANGE_TEMPERATURE(0), 70);
     eeprom_write_byte(EEPROM_MATERIAL_CHANGE_WAIT_TIME(0), 30);
+#ifdef PID_ADD_EXTRUSION_RATE
+    eeprom_write_byte(EEPROM_MATERIAL_FEED_FORWARD(0), 20);
+#endif
 
     strcpy_P(buffer, PSTR("ABS"));
     eeprom_write_block(buffer, EEPROM_MATERIAL_NAME_OFFSET(1), 4);
@@ -1070,6 +1098,9 @@ void lcd_material_reset_defaults()
 
     eeprom_write_word(EEPROM_MATERIAL_CHANGE_TEMPERATURE(1), 90);
     eeprom_write_byte(EEPROM_MATERIAL_CHANGE_WAIT_TIME(1), 30);
+#ifdef PID_ADD_EXTRUSION_RATE
+    eeprom_write_byte(EEPROM_MATERIAL_FEED_FORWARD(1), 24);
+#endif
 
     strcpy_P(buffer, PSTR("CPE"));
     eeprom_write_block(buffer, EEPROM_MATERIAL_NAME_OFFSET(2), 4);
@@ -1099,6 +1130,9 @@ void lcd_material_reset_defaults()
 
     eeprom_write_word(EEPROM_MATERIAL_CHANGE_TEMPERATURE(2), 85);
     eeprom_write_byte(EEPROM_MATERIAL_CHANGE_WAIT_TIME(2), 15);
+#ifdef PID_ADD_EXTRUSION_RATE
+    eeprom_write_byte(EEPROM_MATERIAL_FEED_FORWARD(2), 22);
+#endif
 
     strcpy_P(buffer, PSTR("PC"));
     eeprom_write_block(buffer, EEPROM_MATERIAL_NAME_OFFSET(3), 3);
@@ -1128,6 +1162,9 @@ void lcd_material_reset_defaults()
 
     eeprom_write_word(EEPROM_MATERIAL_CHANGE_TEMPERATURE(3), 85);
     eeprom_write_byte(EEPROM_MATERIAL_CHANGE_WAIT_TIME(3), 15);
+#ifdef PID_ADD_EXTRUSION_RATE
+    eeprom_write_byte(EEPROM_MATERIAL_FEED_FORWARD(3), 25);
+#endif
 
     strcpy_P(buffer, PSTR("Nylon"));
     eeprom_write_block(buffer, EEPROM_MATERIAL_NAME_OFFSET(4), 6);
@@ -1157,6 +1194,9 @@ void lcd_material_reset_defaults()
 
     eeprom_write_word(EEPROM_MATERIAL_CHANGE_TEMPERATURE(4), 85);
     eeprom_write_byte(EEPROM_MATERIAL_CHANGE_WAIT_TIME(4), 15);
+#ifdef PID_ADD_EXTRUSION_RATE
+    eeprom_write_byte(EEPROM_MATERIAL_FEED_FORWARD(4), 20);
+#endif
 
     strcpy_P(buffer, PSTR("CPE+"));
     eeprom_write_block(buffer, EEPROM_MATERIAL_NAME_OFFSET(5), 5);
@@ -1186,6 +1226,9 @@ void lcd_material_reset_defaults()
 
     eeprom_write_word(EEPROM_MATERIAL_CHANGE_TEMPERATURE(5), 85);
     eeprom_write_byte(EEPROM_MATERIAL_CHANGE_WAIT_TIME(5), 15);
+#ifdef PID_ADD_EXTRUSION_RATE
+    eeprom_write_byte(EEPROM_MATERIAL_FEED_FORWARD(5), 24);
+#endif
 
     strcpy_P(buffer, PSTR("TPU 95A"));
     eeprom_write_block(buffer, EEPROM_MATERIAL_NAME_OFFSET(6), 8);
@@ -1215,6 +1258,9 @@ void lcd_material_reset_defaults()
 
     eeprom_write_word(EEPROM_MATERIAL_CHANGE_TEMPERATURE(6), 85);
     eeprom_write_byte(EEPROM_MATERIAL_CHANGE_WAIT_TIME(6), 15);
+#ifdef PID_ADD_EXTRUSION_RATE
+    eeprom_write_byte(EEPROM_MATERIAL_FEED_FORWARD(6), 20);
+#endif
 
     eeprom_write_byte(EEPROM_MATERIAL_COUNT_OFFSET(), 7);
 
@@ -1259,6 +1305,11 @@ void lcd_material_set_material(uint8_t nr, uint8_t e)
     material[e].change_preheat_wait_time = eeprom_read_byte(EEPROM_MATERIAL_CHANGE_WAIT_TIME(nr));
     if (material[e].change_temperature < 10)
         material[e].change_temperature = material[e].temperature[0];
+#ifdef PID_ADD_EXTRUSION_RATE
+    material[e].feed_forward = eeprom_read_byte(EEPROM_MATERIAL_FEED_FORWARD(nr));
+    if (material[e].feed_forward > MATERIAL_FEED_FORWARD_MAX)
+        material[e].feed_forward = 0;
+#endif
 
     lcd_material_store_current_material();
 }
@@ -1284,6 +1335,9 @@ void lcd_material_store_material(uint8_t nr)
 
     eeprom_write_word(EEPROM_MATERIAL_CHANGE_TEMPERATURE(nr), material[active_extruder].change_temperature);
     eeprom_write_byte(EEPROM_MATERIAL_CHANGE_WAIT_TIME(nr), material[active_extruder].change_preheat_wait_time);
+#ifdef PID_ADD_EXTRUSION_RATE
+    eeprom_write_byte(EEPROM_MATERIAL_FEED_FORWARD(nr), material[active_extruder].feed_forward);
+#endif
 }
 
 void lcd_material_read_current_material()
@@ -1313,6 +1367,11 @@ void lcd_material_read_current_material()
         material[e].change_preheat_wait_time = eeprom_read_byte(EEPROM_MATERIAL_CHANGE_WAIT_TIME(EEPROM_MATERIAL_SETTINGS_MAX_COUNT+e));
         if (material[e].change_temperature < 10)
             material[e].change_temperature = material[e].temperature[0];
+#ifdef PID_ADD_EXTRUSION_RATE
+        material[e].feed_forward = eeprom_read_byte(EEPROM_MATERIAL_FEED_FORWARD(EEPROM_MATERIAL_SETTINGS_MAX_COUNT+e));
+        if (material[e].feed_forward > MATERIAL_FEED_FORWARD_MAX)
+            material[e].feed_forward = 0;
+#endif
     }
 }
 
@@ -1338,6 +1397,9 @@ void lcd_material_store_current_material()
 
         eeprom_write_word(EEPROM_MATERIAL_CHANGE_TEMPERATURE(EEPROM_MATERIAL_SETTINGS_MAX_COUNT+e), material[e].change_temperature);
         eeprom_write_byte(EEPROM_MATERIAL_CHANGE_WAIT_TIME(EEPROM_MATERIAL_SETTINGS_MAX_COUNT+e), material[e].change_preheat_wait_time);
+#ifdef PID_ADD_EXTRUSION_RATE
+        eeprom_write_byte(EEPROM_MATERIAL_FEED_FORWARD(EEPROM_MATERIAL_SETTINGS_MAX_COUNT+e), material[e].feed_forward);
+#endif
     }
 }
 
@@ -1401,7 +1463,20 @@ bool lcd_material_verify_material_settings()
                 eeprom_write_byte(EEPROM_MATERIAL_CHANGE_WAIT_TIME(cnt), 5);
             }
         }
+#ifdef PID_ADD_EXTRUSION_RATE
+        //Settings from before the feed forward existed read as erased EEPROM, start those with feed forward off.
+        if (eeprom_read_byte(EEPROM_MATERIAL_FEED_FORWARD(cnt)) > MATERIAL_FEED_FORWARD_MAX)
+            eeprom_write_byte(EEPROM_MATERIAL_FEED_FORWARD(cnt), 0);
+#endif
+    }
+#ifdef PID_ADD_EXTRUSION_RATE
+    //The same goes for the current material of each extruder, which is read when a print starts.
+    for(uint8_t e=0; e<EXTRUDERS; e++)
+    {
+        if (eeprom_read_byte(EEPROM_MATERIAL_FEED_FORWARD(EEPROM_MATERIAL_SETTINGS_MAX_COUNT+e)) > MATERIAL_FEED_FORWARD_MAX)
+            eeprom_write_byte(EEPROM_MATERIAL_FEED_FORWARD(EEPROM_MATERIAL_SETTINGS_MAX_COUNT+e), 0);
     }
+#endif
     return true;
 }
 
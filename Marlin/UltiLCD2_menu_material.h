@@ -8,6 +8,7 @@ Total:             0x0000-0x1000
 Settings:          0x0064-0x00E0 0x7C? (careful with this one)
 ChangeMatSettings: 0x0410-0x0334 (18*2)=0x24
 ChangeMatSettings: 0x0440-0x0352 (18)=0x12
+FeedForward:       0x0460-0x0472 (18)=0x12
 FirstRunDone:      0x0400-0x0400 0x01
 RuntimeStats:      0x0700-0x071C 0x1C
 Materials:         0x0800-0x09B1 (8+16)*18+1=0x1B1
@@ -37,6 +38,9 @@ struct materialSettings
     char name[MATERIAL_NAME_SIZE];
     int16_t change_temperature;      //Temperature for the hotend during the change material procedure.
     int8_t change_preheat_wait_time; //when reaching the change material temperature, wait for this amount of seconds for the temperature to stabalize and the material to heatup.
+#ifdef PID_ADD_EXTRUSION_RATE
+    uint8_t feed_forward; //Extra heater PWM per mm/s of filament, applied as Kc when a print starts. 0 disables it.
+#endif
 };
 
 extern struct materialSettings material[EXTRUDERS];
@@ -59,6 +63,7 @@ extern struct materialSettings material[EXTRUDERS];
 #define EEPROM_MATERIAL_EXTRA_RETRACTION_SETTINGS_OFFSET 0xc50
 #define EEPROM_MATERIAL_CHANGE_TEMPERATURE_OFFSET 0x410
 #define EEPROM_MATERIAL_CHANGE_WAIT_TIME_OFFSET 0x440
+#define EEPROM_MATERIAL_FEED_FORWARD_OFFSET 0x460
 #define EEPROM_MATERIAL_SETTINGS_MAX_COUNT 16
 #define EEPROM_MATERIAL_SETTINGS_SIZE   (8 + 16)
 #define EEPROM_MATERIAL_COUNT_OFFSET()            ((uint8_t*)(EEPROM_MATERIAL_SETTINGS_OFFSET + 0))
@@ -73,6 +78,9 @@ extern struct materialSettings material[EXTRUDERS];
 #define EEPROM_MATERIAL_DIAMETER_OFFSET(n)        ((float*)(EEPROM_MATERIAL_SETTINGS_OFFSET + 1 + EEPROM_MATERIAL_SETTINGS_SIZE * uint16_t(n) + MATERIAL_NAME_SIZE + 7))
 #define EEPROM_MATERIAL_CHANGE_TEMPERATURE(n)     ((uint16_t*)(EEPROM_MATERIAL_CHANGE_TEMPERATURE_OFFSET + uint16_t(n) * 2))
 #define EEPROM_MATERIAL_CHANGE_WAIT_TIME(n)       ((uint8_t*)(EEPROM_MATERIAL_CHANGE_WAIT_TIME_OFFSET + uint16_t(n)))
+#define EEPROM_MATERIAL_FEED_FORWARD(n)           ((uint8_t*)(EEPROM_MATERIAL_FEED_FORWARD_OFFSET + uint16_t(n)))
+//Highest feed forward the material menu allows, larger values read from EEPROM are taken as unset (0).
+#define MATERIAL_FEED_FORWARD_MAX 200
 
 void lcd_menu_material();
 void lcd_change_to_menu_change_material(menuFunc_t return_menu);
@@ -6,6 +6,7 @@
 #include "cardreader.h"
 #include "temperature.h"
 #include "lifetime_stats.h"
+#include "print_checkpoint.h"
 #include "UltiLCD2.h"
 #include "UltiLCD2_hi_lib.h"
 #include "UltiLCD2_menu_print.h"
@@ -25,6 +26,11 @@ uint8_t lcd_cache[LCD_CACHE_SIZE];
 #define LCD_DETAIL_CACHE_MATERIAL(n) (*(uint32_t*)&lcd_cache[LCD_DETAIL_CACHE_START+5+4*n])
 #define LCD_DETAIL_CACHE_NOZZLE_DIAMETER(n) (*(float*)&lcd_cache[LCD_DETAIL_CACHE_START+5+4*EXTRUDERS+4*n])
 #define LCD_DETAIL_CACHE_MATERIAL_TYPE(n) ((char*)&lcd_cache[LCD_DETAIL_CACHE_START+5+8*EXTRUDERS+8*n])
+//First cluster, length and modification time of the cached file names, the key of the header cache.
+#define LCD_CACHE_KEY_START (LCD_DETAIL_CACHE_START+LCD_DETAIL_CACHE_SIZE)
+#define LCD_CACHE_CLUSTER(n) (*(uint32_t*)&lcd_cache[LCD_CACHE_KEY_START+12*(n)])
+#define LCD_CACHE_LENGTH(n) (*(uint32_t*)&lcd_cache[LCD_CACHE_KEY_START+12*(n)+4])
+#define LCD_CACHE_MODIFIED(n) (*(uint32_t*)&lcd_cache[LCD_CACHE_KEY_START+12*(n)+8])
 
 void doCooldown();//TODO
 static void lcd_menu_print_heatup();
@@ -39,9 +45,17 @@ static void lcd_menu_print_ready_cooled_down();
 static void lcd_menu_print_tune();
 static void lcd_menu_print_tune_retraction();
 static void lcd_menu_print_pause();
+#ifdef PRINT_CHECKPOINT
+static void lcd_menu_print_resume_start();
+static void lcd_menu_print_error_resume();
+#endif
 
 bool primed = false;
 static bool pauseRequested = false;
+#if defined(HEATUP_SYNCHRONIZE) && TEMP_SENSOR_BED != 0
+static bool heatup_bed_pending;//lcd_menu_print_heatup still has to decide when the bed heater starts.
+static unsigned int heatup_total_seconds;//Longest estimated heat-up time when the heat-up started, for the progress bar.
+#endif
 
 
 void lcd_clear_cache()
@@ -52,11 +66,58 @@ void lcd_clear_cache()
     LCD_CACHE_NR_OF_FILES() = 0xFF;
 }
 
+//Header details of the last LCD_HEADER_CACHE_COUNT files shown in the file list, most recently shown first.
+//The details are stored in the same layout as the LCD_DETAIL_CACHE_* fields that follow LCD_DETAIL_CACHE_ID().
+struct header_cache_t
+{
+    uint32_t cluster;
+    uint32_t length;
+    uint32_t modified;
+    uint8_t details[LCD_DETAIL_CACHE_SIZE - 1];
+};
+static header_cache_t header_cache[LCD_HEADER_CACHE_COUNT];
+
+//Fill the LCD_DETAIL_CACHE_* fields for the file of file name cache entry n from the header cache, if it is there.
+static bool lcd_header_cache_load(uint8_t n)
+{
+    //Empty files have no cluster and would match the unused entries.
+    if (LCD_CACHE_CLUSTER(n) == 0)
+        return false;
+    for(uint8_t idx=0; idx<LCD_HEADER_CACHE_COUNT; idx++)
+    {
+        if (header_cache[idx].cluster == LCD_CACHE_CLUSTER(n) && header_cache[idx].length == LCD_CACHE_LENGTH(n) && header_cache[idx].modified == LCD_CACHE_MODIFIED(n))
+        {
+            header_cache_t entry = header_cache[idx];
+            memmove(&header_cache[1], &header_cache[0], idx * sizeof(header_cache_t));
+            header_cache[0] = entry;
+            memcpy(&lcd_cache[LCD_DETAIL_CACHE_START+1], entry.details, sizeof(entry.details));
+            return true;
+        }
+    }
+    return false;
+}
+
+//Store the LCD_DETAIL_CACHE_* fields just read from the file of file name cache entry n, dropping the least recently shown file.
+static void lcd_header_cache_store(uint8_t n)
+{
+    memmove(&header_cache[1], &header_cache[0], (LCD_HEADER_CACHE_COUNT - 1) * sizeof(header_cache_t));
+    header_cache[0].cluster = LCD_CACHE_CLUSTER(n);
+    header_cache[0].length = LCD_CACHE_LENGTH(n);
+    header_cache[0].modified = LCD_CACHE_MODIFIED(n);
+    memcpy(header_cache[0].details, &lcd_cache[LCD_DETAIL_CACHE_START+1], sizeof(header_cache[0].details));
+}
+
 static void abortPrint()
 {
     postMenuCheck = NULL;
     lifetime_stats_print_end();
+#ifdef PRINT_CHECKPOINT
+    print_checkpoint_clear();
+#endif
     doCooldown();
+#if defined(HEATUP_SYNCHRONIZE) && TEMP_SENSOR_BED != 0
+    heatupDelayBed(0);
+#endif
 
     clear_command_queue();
     char buffer[32];
@@ -214,6 +275,9 @@ static char* lcd_sd_menu_filename_callback(uint8_t nr)
             LCD_CACHE_ID(idx) = nr;
             strcpy(LCD_CACHE_FILENAME(idx), card.longFilename);
             LCD_CACHE_TYPE(idx) = card.filenameIsDir ? 1 : 0;
+            LCD_CACHE_CLUSTER(idx) = card.fileCluster;
+            LCD_CACHE_LENGTH(idx) = card.fileLength;
+            LCD_CACHE_MODIFIED(idx) = card.fileModified;
             if (card.errorCode() && card.sdInserted)
             {
                 //On a read error reset the file position and try to keep going. (not pretty, but these read errors are annoying as hell)
@@ -243,58 +307,65 @@ void lcd_sd_menu_details_callback(uint8_t nr)
                 char buffer[64];
                 if (LCD_DETAIL_CACHE_ID() != nr)
                 {
-                    card.getfilename(nr - 1);
-                    if (card.errorCode())
-                    {
-                        card.clearError();
-                        return;
-                    }
-                    LCD_DETAIL_CACHE_ID() = nr;
-                    LCD_DETAIL_CACHE_TIME() = 0;
-                    for(uint8_t e=0; e<EXTRUDERS; e++)
+                    if (lcd_header_cache_load(idx))
                     {
-                        LCD_DETAIL_CACHE_MATERIAL(e) = 0;
-                        LCD_DETAIL_CACHE_NOZZLE_DIAMETER(e) = 0.4;
-                        LCD_DETAIL_CACHE_MATERIAL_TYPE(e)[0] = '\0';
-                    }
-                    card.openFile(card.filename, true);
-                    if (card.isFileOpen())
-                    {
-                        for(uint8_t n=0;n<16;n++)
+                        LCD_DETAIL_CACHE_ID() = nr;
+                    }else{
+                        card.getfilename(nr - 1);
+                        if (card.errorCode())
                         {
-                            card.fgets(buffer, sizeof(buffer));
-                            buffer[sizeof(buffer)-1] = '\0';
-                            while (strlen(buffer) > 0 && buffer[strlen(buffer)-1] < ' ') buffer[strlen(buffer)-1] = '\0';
-                            if (strncmp_P(buffer, PSTR(";TIME:"), 6) == 0)
-                                LCD_DETAIL_CACHE_TIME() = atol(buffer + 6);
-                            else if (strncmp_P(buffer, PSTR(";MATERIAL:"), 10) == 0)
-                                LCD_DETAIL_CACHE_MATERIAL(0) = atol(buffer + 10);
-                            else if (strncmp_P(buffer, PSTR(";NOZZLE_DIAMETER:"), 17) == 0)
-                                LCD_DETAIL_CACHE_NOZZLE_DIAMETER(0) = strtod(buffer + 17, NULL);
-                            else if (strncmp_P(buffer, PSTR(";MTYPE:"), 7) == 0)
+                            card.clearError();
+                            return;
+                        }
+                        LCD_DETAIL_CACHE_ID() = nr;
+                        LCD_DETAIL_CACHE_TIME() = 0;
+                        for(uint8_t e=0; e<EXTRUDERS; e++)
+                        {
+                            LCD_DETAIL_CACHE_MATERIAL(e) = 0;
+                            LCD_DETAIL_CACHE_NOZZLE_DIAMETER(e) = 0.4;
+                            LCD_DETAIL_CACHE_MATERIAL_TYPE(e)[0] = '\0';
+                        }
+                        card.openFile(card.filename, true);
+                        if (card.isFileOpen())
+                        {
+                            for(uint8_t n=0;n<16;n++)
                             {
-                                strncpy(LCD_DETAIL_CACHE_MATERIAL_TYPE(0), buffer + 7, 8);
-                                LCD_DETAIL_CACHE_MATERIAL_TYPE(0)[7] = '\0';
-                            }
+                                card.fgets(buffer, sizeof(buffer));
+                                buffer[sizeof(buffer)-1] = '\0';
+                                while (strlen(buffer) > 0 && buffer[strlen(buffer)-1] < ' ') buffer[strlen(buffer)-1] = '\0';
+                                if (strncmp_P(buffer, PSTR(";TIME:"), 6) == 0)
+                                    LCD_DETAIL_CACHE_TIME() = atol(buffer + 6);
+                                else if (strncmp_P(buffer, PSTR(";MATERIAL:"), 10) == 0)
+                                    LCD_DETAIL_CACHE_MATERIAL(0) = atol(buffer + 10);
+                                else if (strncmp_P(buffer, PSTR(";NOZZLE_DIAMETER:"), 17) == 0)
+                                    LCD_DETAIL_CACHE_NOZZLE_DIAMETER(0) = strtod(buffer + 17, NULL);
+                                else if (strncmp_P(buffer, PSTR(";MTYPE:"), 7) == 0)
+                                {
+                                    strncpy(LCD_DETAIL_CACHE_MATERIAL_TYPE(0), buffer + 7, 8);
+                                    LCD_DETAIL_CACHE_MATERIAL_TYPE(0)[7] = '\0';
+                                }
 #if EXTRUDERS > 1
-                            else if (strncmp_P(buffer, PSTR(";MATERIAL2:"), 11) == 0)
-                                LCD_DETAIL_CACHE_MATERIAL(1) = atol(buffer + 11);
-                            else if (strncmp_P(buffer, PSTR(";NOZZLE_DIAMETER2:"), 18) == 0)
-                                LCD_DETAIL_CACHE_NOZZLE_DIAMETER(1) = strtod(buffer + 18, NULL);
-                            else if (strncmp_P(buffer, PSTR(";MTYPE2:"), 8) == 0)
-                            {
-                                strncpy(LCD_DETAIL_CACHE_MATERIAL_TYPE(1), buffer + 8, 8);
-                                LCD_DETAIL_CACHE_MATERIAL_TYPE(1)[7] = '\0';
-                            }
+                                else if (strncmp_P(buffer, PSTR(";MATERIAL2:"), 11) == 0)
+                                    LCD_DETAIL_CACHE_MATERIAL(1) = atol(buffer + 11);
+                                else if (strncmp_P(buffer, PSTR(";NOZZLE_DIAMETER2:"), 18) == 0)
+                                    LCD_DETAIL_CACHE_NOZZLE_DIAMETER(1) = strtod(buffer + 18, NULL);
+                                else if (strncmp_P(buffer, PSTR(";MTYPE2:"), 8) == 0)
+                                {
+                                    strncpy(LCD_DETAIL_CACHE_MATERIAL_TYPE(1), buffer + 8, 8);
+                                    LCD_DETAIL_CACHE_MATERIAL_TYPE(1)[7] = '\0';
+                                }
 #endif
                             
+                            }
                         }
-                    }
-                    if (card.errorCode())
-                    {
-                        //On a read error reset the file position and try to keep going. (not pretty, but these read errors are annoying as hell)
-                        card.clearError();
-                        LCD_DETAIL_CACHE_ID() = 255;
+                        if (card.errorCode())
+                        {
+                            //On a read error reset the file position and try to keep going. (not pretty, but these read errors are annoying as hell)
+                            card.clearError();
+                            LCD_DETAIL_CACHE_ID() = 255;
+                        }
+                        else
+                            lcd_header_cache_store(idx);
                     }
                 }
 
@@ -447,10 +518,18 @@ void lcd_menu_print_select()
                             fanSpeedPercent = max(fanSpeedPercent, material[e].fan_speed);
                             volume_to_filament_length[e] = 1.0 / (M_PI * (material[e].diameter / 2.0) * (material[e].diameter / 2.0));
                             extrudemultiply[e] = material[e].flow;
+#ifdef PID_ADD_EXTRUSION_RATE
+                            Kc[e] = material[e].feed_forward;
+#endif
                             retract_feedrate = material[e].retraction_speed[nozzleSizeToTemperatureIndex(LCD_DETAIL_CACHE_NOZZLE_DIAMETER(e))];
                             retract_length = material[e].retraction_length[nozzleSizeToTemperatureIndex(LCD_DETAIL_CACHE_NOZZLE_DIAMETER(e))];
                         }
 
+#if defined(HEATUP_SYNCHRONIZE) && TEMP_SENSOR_BED != 0
+                        heatup_bed_pending = true;
+                        heatup_total_seconds = 0;
+#endif
+
                         enquecommand_P(PSTR("G28"));
                         enquecommand_P(PSTR(HEATUP_POSITION_COMMAND));
                         lcd_change_to_menu(lcd_menu_print_heatup);
@@ -488,10 +567,138 @@ void lcd_menu_print_select()
     lcd_scroll_menu(PSTR("SD CARD"), nrOfFiles+1, lcd_sd_menu_filename_callback, lcd_sd_menu_details_callback);
 }
 
+#ifdef PRINT_CHECKPOINT
+//Shown at startup when a print was interrupted, by a power loss for example.
+void lcd_menu_print_resume()
+{
+    lcd_question_screen(lcd_menu_print_resume_start, NULL, PSTR("RESUME"), lcd_menu_main, print_checkpoint_clear, PSTR("DISCARD"));
+
+    char path[PRINT_CHECKPOINT_PATH_LENGTH];
+    lcd_lib_draw_string_centerP(10, PSTR("Print interrupted:"));
+    lcd_lib_draw_string_center(20, print_checkpoint_filename(path));
+    lcd_lib_draw_string_centerP(30, PSTR("Resume printing?"));
+    lcd_lib_update_screen();
+}
+
+static void lcd_menu_print_resume_start()
+{
+    if (!card.sdInserted)
+    {
+        LED_GLOW();
+        lcd_info_screen(lcd_menu_main);
+        lcd_lib_draw_string_centerP(15, PSTR("No SD-CARD!"));
+        lcd_lib_draw_string_centerP(25, PSTR("Please insert card"));
+        lcd_lib_update_screen();
+        card.release();
+        return;
+    }
+    if (!card.isOk())
+    {
+        lcd_info_screen(lcd_menu_main);
+        lcd_lib_draw_string_centerP(16, PSTR("Reading card..."));
+        lcd_lib_update_screen();
+        lcd_clear_cache();
+        card.initsd();
+        return;
+    }
+    if (!print_checkpoint_resume())
+    {
+        currentMenu = lcd_menu_print_error_resume;
+        return;
+    }
+
+    if (led_mode == LED_MODE_WHILE_PRINTING || led_mode == LED_MODE_BLINK_ON_DONE)
+        analogWrite(LED_PIN, 255 * int(led_brightness_level) / 100);
+    char path[PRINT_CHECKPOINT_PATH_LENGTH];
+    lcd_clear_cache();
+    LCD_CACHE_ID(0) = 255;
+    strncpy(LCD_CACHE_FILENAME(0), print_checkpoint_filename(path), LONG_FILENAME_LENGTH - 1);
+    LCD_CACHE_FILENAME(0)[LONG_FILENAME_LENGTH - 1] = '\0';
+    if (strchr(LCD_CACHE_FILENAME(0), '.')) strchr(LCD_CACHE_FILENAME(0), '.')[0] = '\0';
+    LCD_DETAIL_CACHE_TIME() = 0;
+    primed = true;
+    postMenuCheck = checkPrintFinished;
+    lifetime_stats_print_start();
+    starttime = millis();
+    currentMenu = lcd_menu_print_printing;
+}
+
+static void lcd_menu_print_error_resume()
+{
+    LED_GLOW_ERROR();
+    lcd_info_screen(lcd_menu_main, print_checkpoint_clear, PSTR("RETURN TO MAIN"));
+
+    lcd_lib_draw_string_centerP(10, PSTR("Can not resume:"));
+    lcd_lib_draw_string_centerP(20, PSTR("the file is missing"));
+    lcd_lib_draw_string_centerP(30, PSTR("or has changed."));
+    lcd_lib_update_screen();
+}
+#endif//PRINT_CHECKPOINT
+
 static void lcd_menu_print_heatup()
 {
     lcd_question_screen(lcd_menu_print_tune, NULL, PSTR("TUNE"), lcd_menu_print_abort, NULL, PSTR("ABORT"));
 
+#if defined(HEATUP_SYNCHRONIZE) && TEMP_SENSOR_BED != 0
+    //Start each heater once its estimated heat-up time reaches the longest time any heater still needs,
+    // so the bed and the nozzles reach their temperature together without the nozzles oozing while waiting for the bed.
+    int nozzle_target[EXTRUDERS];
+    unsigned int longest = heatupSeconds(HEATUP_BED, target_temperature_bed);
+    for(uint8_t e=0; e<EXTRUDERS; e++)
+    {
+        nozzle_target[e] = target_temperature[e];
+        if (LCD_DETAIL_CACHE_MATERIAL(e) < 1)
+            continue;
+        if (nozzle_target[e] < 1)
+            nozzle_target[e] = material[e].temperature[nozzleSizeToTemperatureIndex(LCD_DETAIL_CACHE_NOZZLE_DIAMETER(e))];
+        longest = max(longest, heatupSeconds(e, nozzle_target[e]));
+    }
+
+    bool started = true;
+    if (heatup_bed_pending || heatupBedDelayed())
+    {
+        //The bed keeps its target, so TUNE shows and changes it, temperature.cpp only holds the heater back.
+        unsigned int bed_seconds = heatupSeconds(HEATUP_BED, target_temperature_bed) + HEATUP_SYNC_MARGIN;
+        if (bed_seconds >= longest)
+        {
+            heatupDelayBed(0);
+        }else{
+            heatupDelayBed(longest - bed_seconds);
+            started = false;
+        }
+        heatup_bed_pending = false;
+    }
+    for(uint8_t e=0; e<EXTRUDERS; e++)
+    {
+        if (LCD_DETAIL_CACHE_MATERIAL(e) < 1 || target_temperature[e] > 0)
+            continue;
+        if (heatupSeconds(e, nozzle_target[e]) + HEATUP_SYNC_MARGIN >= longest)
+            target_temperature[e] = nozzle_target[e];
+        else
+            started = false;
+    }
+
+    if (started && current_temperature_bed >= target_temperature_bed - TEMP_WINDOW * 2 && !is_command_queued())
+    {
+        bool ready = true;
+        for(uint8_t e=0; e<EXTRUDERS; e++)
+            if (current_temperature[e] < target_temperature[e] - TEMP_WINDOW)
+                ready = false;
+
+        if (ready)
+        {
+            doStartPrint();
+            currentMenu = lcd_menu_print_printing;
+        }
+    }
+
+    //Not all heaters run yet, so show the progress in estimated time instead of temperature.
+    if (heatup_total_seconds < longest)
+        heatup_total_seconds = longest;
+    uint8_t progress = 125;
+    if (heatup_total_seconds > 0)
+        progress = 125 - (unsigned long)longest * 125 / heatup_total_seconds;
+#else
 #if TEMP_SENSOR_BED != 0
     if (current_temperature_bed > target_temperature_bed - 10)
     {
@@ -536,6 +743,7 @@ static void lcd_menu_print_heatup()
     else if (target_temperature_bed > current_temperature_bed - 20)
         progress = 0;
 #endif
+#endif//HEATUP_SYNCHRONIZE
 
     if (progress < minProgress)
         progress = minProgress;
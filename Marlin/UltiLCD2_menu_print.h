@@ -5,10 +5,15 @@
 
 #define LCD_CACHE_COUNT 6
 #define LCD_DETAIL_CACHE_SIZE (5+8*EXTRUDERS+8*EXTRUDERS)
-#define LCD_CACHE_SIZE (1 + (2 + LONG_FILENAME_LENGTH) * LCD_CACHE_COUNT + LCD_DETAIL_CACHE_SIZE)
+#define LCD_CACHE_SIZE (1 + (2 + LONG_FILENAME_LENGTH + 12) * LCD_CACHE_COUNT + LCD_DETAIL_CACHE_SIZE)
+//Number of files whose header details (time, material, nozzle size) are kept after they were shown, so scrolling back to them does not read the card.
+#define LCD_HEADER_CACHE_COUNT 4
 extern uint8_t lcd_cache[LCD_CACHE_SIZE];
 
 void lcd_menu_print_select();
+#ifdef PRINT_CHECKPOINT
+void lcd_menu_print_resume();
+#endif
 void lcd_clear_cache();
 void doCancelPrint();
 
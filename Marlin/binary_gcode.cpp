@@ -0,0 +1,217 @@
+#include "Marlin.h"
+#include "binary_gcode.h"
+
+#ifdef BINARY_GCODE
+
+#define STATE_SYNC     0
+#define STATE_SEQUENCE 1
+#define STATE_TYPE     2
+#define STATE_LENGTH   3
+#define STATE_PAYLOAD  4
+#define STATE_CRC_LOW  5
+#define STATE_CRC_HIGH 6
+
+bool binary_gcode_mode = false;
+binary_gcode_decoder_t binary_gcode_serial;
+#ifdef SDSUPPORT
+binary_gcode_decoder_t binary_gcode_sd;
+#endif
+
+static uint16_t crc16_update(uint16_t crc, uint8_t data)
+{
+    crc ^= (uint16_t)data << 8;
+    for(uint8_t n=0; n<8; n++)
+    {
+        if (crc & 0x8000)
+            crc = (crc << 1) ^ 0x1021;
+        else
+            crc <<= 1;
+    }
+    return crc;
+}
+
+void binary_gcode_reset(binary_gcode_decoder_t* decoder, bool sequenced, uint8_t sequence)
+{
+    decoder->state = STATE_SYNC;
+    decoder->sequenced = sequenced;
+    decoder->expected_sequence = sequence;
+    decoder->resend_requested = false;
+    for(uint8_t n=0; n<NUM_AXIS; n++)
+        decoder->last_position[n] = 0;
+}
+
+void binary_gcode_resync(binary_gcode_decoder_t* decoder)
+{
+    decoder->state = STATE_SYNC;
+    decoder->resend_requested = false;
+}
+
+void binary_gcode_start(uint8_t sequence)
+{
+    binary_gcode_mode = true;
+    binary_gcode_reset(&binary_gcode_serial, true, sequence);
+}
+
+uint8_t binary_gcode_expected_sequence()
+{
+    return binary_gcode_serial.expected_sequence;
+}
+
+//Append " <axis><value / 10^decimals>" without going through floats.
+static char* append_fixed(char* p, char axis, long value, uint8_t decimals)
+{
+    *p++ = ' ';
+    *p++ = axis;
+    if (value < 0)
+    {
+        *p++ = '-';
+        value = -value;
+    }
+    char digits[12];
+    uint8_t n = 0;
+    do
+    {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while(value > 0 || n <= decimals);
+    while(n > 0)
+    {
+        if (n == decimals)
+            *p++ = '.';
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+void binary_gcode_move_text(const binary_gcode_move_t* move, char* cmd)
+{
+    static const char axis_name[NUM_AXIS] = {'X', 'Y', 'Z', 'E'};
+    char* p = cmd;
+    *p++ = 'G';
+    *p++ = (move->flags & BINARY_GCODE_MOVE_G0) ? '0' : '1';
+    for(uint8_t axis=0; axis<NUM_AXIS; axis++)
+    {
+        if (move->flags & _BV(axis))
+            p = append_fixed(p, axis_name[axis], move->position[axis], axis == E_AXIS ? 4 : 3);
+    }
+    if (move->flags & BINARY_GCODE_MOVE_F)
+        p = append_fixed(p, 'F', move->feedrate, 0);
+    *p = '\0';
+}
+
+static bool decode_move(binary_gcode_decoder_t* decoder, binary_gcode_move_t* move)
+{
+    uint8_t flags = decoder->move_payload[0];
+    uint8_t size = (flags & BINARY_GCODE_MOVE_DELTA) ? 2 : 4;
+    uint8_t pos = 1;
+    const uint8_t* payload = decoder->move_payload;
+    move->flags = flags & ~BINARY_GCODE_MOVE_DELTA;
+    for(uint8_t axis=0; axis<NUM_AXIS; axis++)
+    {
+        if (!(flags & _BV(axis)))
+            continue;
+        if (pos + size > decoder->length)
+            return false;
+        if (size == 2)
+        {
+            decoder->last_position[axis] += (int16_t)(payload[pos] | (payload[pos + 1] << 8));
+        }else{
+            decoder->last_position[axis] = (int32_t)((uint32_t)payload[pos] | ((uint32_t)payload[pos + 1] << 8) | ((uint32_t)payload[pos + 2] << 16) | ((uint32_t)payload[pos + 3] << 24));
+        }
+        pos += size;
+        move->position[axis] = decoder->last_position[axis];
+    }
+    if (flags & BINARY_GCODE_MOVE_F)
+    {
+        if (pos + 2 > decoder->length)
+            return false;
+        move->feedrate = payload[pos] | (payload[pos + 1] << 8);
+        pos += 2;
+    }
+    return pos == decoder->length;
+}
+
+static uint8_t frame_error(binary_gcode_decoder_t* decoder)
+{
+    decoder->state = STATE_SYNC;
+    if (decoder->resend_requested)
+        return BINARY_GCODE_NONE;
+    decoder->resend_requested = true;
+    return BINARY_GCODE_RESEND;
+}
+
+uint8_t binary_gcode_feed(binary_gcode_decoder_t* decoder, uint8_t c, char* cmd)
+{
+    switch(decoder->state)
+    {
+    case STATE_SYNC:
+        if (c == BINARY_GCODE_SYNC)
+        {
+            decoder->crc = 0xFFFF;
+            decoder->state = STATE_SEQUENCE;
+        }
+        return BINARY_GCODE_NONE;
+    case STATE_SEQUENCE:
+        decoder->sequence = c;
+        decoder->state = STATE_TYPE;
+        break;
+    case STATE_TYPE:
+        decoder->type = c;
+        decoder->state = STATE_LENGTH;
+        break;
+    case STATE_LENGTH:
+        decoder->length = c;
+        decoder->count = 0;
+        if ((decoder->type == BINARY_GCODE_MOVE && (c < 1 || c > sizeof(decoder->move_payload))) || (decoder->type == BINARY_GCODE_TEXT && c > MAX_CMD_SIZE - 1) || (decoder->type == BINARY_GCODE_EXIT && c != 0) || decoder->type < BINARY_GCODE_MOVE || decoder->type > BINARY_GCODE_EXIT)
+            return frame_error(decoder);
+        decoder->state = (c > 0) ? STATE_PAYLOAD : STATE_CRC_LOW;
+        break;
+    case STATE_PAYLOAD:
+        if (decoder->type == BINARY_GCODE_MOVE)
+            decoder->move_payload[decoder->count] = c;
+        else
+            cmd[decoder->count] = c;
+        if (++decoder->count == decoder->length)
+            decoder->state = STATE_CRC_LOW;
+        break;
+    case STATE_CRC_LOW:
+        decoder->frame_crc = c;
+        decoder->state = STATE_CRC_HIGH;
+        return BINARY_GCODE_NONE;
+    case STATE_CRC_HIGH:
+        decoder->frame_crc |= c << 8;
+        decoder->state = STATE_SYNC;
+        if (decoder->frame_crc != decoder->crc)
+            return frame_error(decoder);
+        if (decoder->sequenced && decoder->sequence != decoder->expected_sequence)
+        {
+            //A frame from before the requested resend, or a lost frame.
+            return frame_error(decoder);
+        }
+        decoder->resend_requested = false;
+        decoder->expected_sequence++;
+        if (decoder->type == BINARY_GCODE_EXIT)
+        {
+            if (decoder == &binary_gcode_serial)
+                binary_gcode_mode = false;
+            return BINARY_GCODE_ACK;
+        }
+        if (decoder->type == BINARY_GCODE_TEXT)
+        {
+            cmd[decoder->length] = '\0';
+            return BINARY_GCODE_COMMAND;
+        }
+        if (!decode_move(decoder, (binary_gcode_move_t*)cmd))
+        {
+            //Flags and length do not match, the host has a bug. Resending will not help, so skip the frame.
+            SERIAL_ERROR_START;
+            SERIAL_ERRORLNPGM("Bad binary move frame");
+            return BINARY_GCODE_ACK;
+        }
+        return BINARY_GCODE_RECORD;
+    }
+    decoder->crc = crc16_update(decoder->crc, c);
+    return BINARY_GCODE_NONE;
+}
+
+#endif//BINARY_GCODE
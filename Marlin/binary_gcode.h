@@ -0,0 +1,91 @@
+#ifndef BINARY_GCODE_H
+#define BINARY_GCODE_H
+
+#include "Marlin.h"
+
+#ifdef BINARY_GCODE
+/*
+  Binary G-code frames, switched on with M880 and off with an exit frame (or a reset of the board).
+  A frame is:
+    0xA5, sequence number, type, payload length, payload, CRC16 low byte, CRC16 high byte
+  The CRC16 is CCITT (polynomial 0x1021, start value 0xFFFF) over everything after the 0xA5, up to the CRC.
+  Sequence numbers count up from the M880 S value (default 0) and wrap at 256. A bad frame or a missing sequence number gets
+  "Resend: <sequence number>" followed by "ok", the frames after it are dropped until the requested frame arrives.
+  Every frame that results in a command is acknowledged with "ok" just like an ASCII line, so the host keeps the same window.
+
+  Frame types:
+    BINARY_GCODE_MOVE: flags byte, then for every flagged axis a little endian value in X/Y/Z: 1/1000mm, E: 1/10000mm,
+      F: uint16 mm/min. Axis values are int32 absolute positions, or int16 steps from the value the previous move frame gave
+      that axis when BINARY_GCODE_MOVE_DELTA is set. The move is queued as a binary_gcode_move_t with the absolute values,
+      which process_commands() executes as "G1" (or "G0") without parsing any text.
+    BINARY_GCODE_TEXT: a plain ASCII command, without line number and checksum.
+    BINARY_GCODE_EXIT: back to ASCII G-code.
+
+  Binary print files on the SD card are the same frames back to back, starting with the first 0xA5 of the file, which is how
+  they are told apart from ASCII G-code files. Their sequence numbers are not checked and exit frames are ignored. A frame
+  with a bad CRC is read again, and ends the print with an error when it stays bad, as does a move frame that does not match
+  its length. createBinaryGcode.py converts ASCII G-code files to this format.
+*/
+#define BINARY_GCODE_SYNC 0xA5
+
+#define BINARY_GCODE_MOVE 1
+#define BINARY_GCODE_TEXT 2
+#define BINARY_GCODE_EXIT 3
+
+#define BINARY_GCODE_MOVE_X     _BV(0)
+#define BINARY_GCODE_MOVE_Y     _BV(1)
+#define BINARY_GCODE_MOVE_Z     _BV(2)
+#define BINARY_GCODE_MOVE_E     _BV(3)
+#define BINARY_GCODE_MOVE_F     _BV(4)
+#define BINARY_GCODE_MOVE_G0    _BV(5)
+#define BINARY_GCODE_MOVE_DELTA _BV(6)
+
+//Results of binary_gcode_feed
+#define BINARY_GCODE_NONE    0 //Nothing yet, feed more bytes
+#define BINARY_GCODE_COMMAND 1 //A 0 terminated command is in the buffer
+#define BINARY_GCODE_RESEND  2 //Bad frame, request binary_gcode_expected_sequence()
+#define BINARY_GCODE_ACK     3 //Frame accepted without a command (exit frame, or a move frame that does not match its length)
+#define BINARY_GCODE_RECORD  4 //A binary_gcode_move_t is in the buffer
+
+//A decoded move frame. Only the axes (and F) flagged in flags are set.
+typedef struct {
+    uint8_t flags;           //BINARY_GCODE_MOVE_X..BINARY_GCODE_MOVE_F and BINARY_GCODE_MOVE_G0
+    long position[NUM_AXIS]; //Absolute, X/Y/Z in 1/1000mm, E in 1/10000mm
+    uint16_t feedrate;       //mm/min
+} binary_gcode_move_t;
+
+//Frame decoder state of one byte stream.
+typedef struct {
+    uint8_t state;
+    bool sequenced;          //Check sequence numbers and request resends (the serial port), or not (a file)
+    uint8_t expected_sequence;
+    bool resend_requested;
+    uint8_t sequence;
+    uint8_t type;
+    uint8_t length;
+    uint8_t count;
+    uint16_t crc;
+    uint16_t frame_crc;
+    uint8_t move_payload[1 + 4 * 4 + 2]; //Largest move payload: flags, X Y Z E as int32 and F.
+    long last_position[NUM_AXIS];        //Last value each axis got from a move frame, in the frame units. Delta moves build on these.
+} binary_gcode_decoder_t;
+
+extern bool binary_gcode_mode;
+extern binary_gcode_decoder_t binary_gcode_serial;
+#ifdef SDSUPPORT
+extern binary_gcode_decoder_t binary_gcode_sd;
+#endif
+
+void binary_gcode_start(uint8_t sequence);
+uint8_t binary_gcode_expected_sequence();
+//Start decoding a new stream, all positions start at 0.
+void binary_gcode_reset(binary_gcode_decoder_t* decoder, bool sequenced, uint8_t sequence);
+//Drop the frame being decoded and wait for the next sync byte, keeping the positions.
+void binary_gcode_resync(binary_gcode_decoder_t* decoder);
+//Feed one received byte. The command of a frame is decoded into cmd (of MAX_CMD_SIZE), which must not change during a frame.
+uint8_t binary_gcode_feed(binary_gcode_decoder_t* decoder, uint8_t c, char* cmd);
+//Write a decoded move as a "G1 X.. Y.." text command into cmd, for when the text itself is needed.
+void binary_gcode_move_text(const binary_gcode_move_t* move, char* cmd);
+#endif
+
+#endif//BINARY_GCODE_H
@@ -5,6 +5,8 @@
 #include "stepper.h"
 #include "temperature.h"
 #include "language.h"
+#include "binary_gcode.h"
+#include "print_checkpoint.h"
 
 #ifdef SDSUPPORT
 
@@ -14,7 +16,20 @@ CardReader::CardReader()
 {
    filesize = 0;
    sdpos = 0;
+#if SD_READ_BUFFER_SIZE > 0
+   readBufferPos = 0;
+   readLength = readIndex = 0;
+#endif
+   dirIndexClear();
+#if SD_SORT_LIMIT > 0
+   sortCount = 0;
+   sortMode = SD_SORT_DEFAULT;
+   sortStale = true;
+#endif
    sdprinting = false;
+#ifdef BINARY_GCODE
+   binaryFile = false;
+#endif
    pause = false;
    cardOK = false;
    saving = false;
@@ -56,7 +71,8 @@ void  CardReader::lsDive(const char *prepend,SdFile parent)
   dir_t p;
  uint8_t cnt=0;
 
-  while (parent.readDir(p, longFilename) > 0)
+  //pos is where the readDir() that returns the next entry starts, including its long filename entries.
+  for (uint32_t pos = parent.curPosition(); parent.readDir(p, longFilename) > 0; pos = parent.curPosition())
   {
     if( DIR_IS_SUBDIR(&p) && lsAction!=LS_Count && lsAction!=LS_GetFilename) // hence LS_SerialPrint
     {
@@ -121,12 +137,20 @@ void  CardReader::lsDive(const char *prepend,SdFile parent)
       }
       else if(lsAction==LS_Count)
       {
+#if SD_DIR_INDEX_SIZE > 0
+        dirIndexAdd(pos);
+#endif
         nrFiles++;
       }
       else if(lsAction==LS_GetFilename)
       {
         if(cnt==nrFiles)
+        {
+          fileCluster = ((uint32_t)p.firstClusterHigh << 16) | p.firstClusterLow;
+          fileLength = p.fileSize;
+          fileModified = ((uint32_t)p.lastWriteDate << 16) | p.lastWriteTime;
           return;
+        }
         cnt++;
 
       }
@@ -144,10 +168,43 @@ void CardReader::ls()
   lsDive("",root);
 }
 
+#if SD_DIR_INDEX_SIZE > 0
+void CardReader::dirIndexAdd(uint32_t pos)
+{
+  if (nrFiles % dirIndexStep)
+    return;
+  if (dirIndexCount == SD_DIR_INDEX_SIZE)
+  {
+    //Index full, drop every other slot so it keeps covering the whole directory.
+    for(uint8_t i=0; i<SD_DIR_INDEX_SIZE/2; i++)
+      dirIndex[i] = dirIndex[i*2];
+    dirIndexCount = SD_DIR_INDEX_SIZE/2;
+    dirIndexStep *= 2;
+    if (nrFiles % dirIndexStep)
+      return;
+  }
+  dirIndex[dirIndexCount++] = pos >> 5;
+}
+#endif
+
+//The working directory changed, or entries were added to or removed from it. The directory positions and the sort order
+//no longer match its entries until it is counted again with getnrfilenames().
+void CardReader::dirChanged()
+{
+  dirIndexClear();
+#if SD_SORT_LIMIT > 0
+  sortCount = 0;
+  sortStale = true;
+#endif
+}
 
 void CardReader::initsd()
 {
+  //An upload that was not ended with M29 still frees its reserved clusters.
+  if (saving)
+    closefile();
   cardOK = false;
+  dirChanged();
   if(root.isOpen())
     root.close();
 #ifdef SDSLOW
@@ -196,9 +253,13 @@ void CardReader::setroot()
   workDir=root;
 
   curDir=&workDir;
+  dirChanged();
 }
 void CardReader::release()
 {
+  if (saving)
+    closefile();
+  dirChanged();
   sdprinting = false;
   pause = false;
   cardOK = false;
@@ -208,6 +269,21 @@ void CardReader::startFileprint()
 {
   if(cardOK)
   {
+#if SD_MAX_EXTENTS > 0
+    //Map the file's clusters once, so reading it during the print needs no FAT lookups.
+    file.mapExtents();
+#endif
+#ifdef PRINT_CHECKPOINT
+#ifdef BINARY_GCODE
+    //Binary files can not be checkpointed: delta moves can not be continued from the middle of the file. A new print still
+    //drops the checkpoint of the previous one.
+    if (binaryFile)
+      print_checkpoint_clear();
+    else
+#endif
+    if (sdpos == 0)
+      print_checkpoint_start();
+#endif
     sdprinting = true;
     pause = false;
   }
@@ -224,15 +300,18 @@ void CardReader::pauseSDPrint()
 
 void CardReader::openLogFile(const char* name)
 {
-  logging = true;
   openFile(name, false);
+  logging = true;
 }
 
 void CardReader::openFile(const char* name,bool read)
 {
   if(!cardOK)
     return;
-  file.close();
+  if (saving)
+    closefile();
+  else
+    file.close();
   sdprinting = false;
   pause = false;
 
@@ -295,6 +374,17 @@ void CardReader::openFile(const char* name,bool read)
       SERIAL_PROTOCOLPGM(MSG_SD_SIZE);
       SERIAL_PROTOCOLLN(filesize);
       sdpos = 0;
+#if SD_READ_BUFFER_SIZE > 0
+      readBufferPos = 0;
+      readLength = readIndex = 0;
+#endif
+#ifdef BINARY_GCODE
+      //Files that start with the sync byte hold binary frames instead of text.
+      binaryFile = (file.read() == BINARY_GCODE_SYNC);
+      file.seekSet(0);
+      if (binaryFile)
+        binary_gcode_reset(&binary_gcode_sd, false, 0);
+#endif
 
       SERIAL_PROTOCOLLNPGM(MSG_SD_FILE_SELECTED);
       lcd_setstatus(fname);
@@ -316,6 +406,10 @@ void CardReader::openFile(const char* name,bool read)
     }
     else
     {
+      dirChanged();
+#if SD_WRITE_PREALLOCATE > 0
+      writeReserved = 0;
+#endif
       saving = true;
       SERIAL_PROTOCOLPGM(MSG_SD_WRITE_TO_FILE);
       SERIAL_PROTOCOLLN(name);
@@ -329,7 +423,10 @@ void CardReader::removeFile(const char* name)
 {
   if(!cardOK)
     return;
-  file.close();
+  if (saving)
+    closefile();
+  else
+    file.close();
   sdprinting = false;
   pause = false;
 
@@ -384,6 +481,7 @@ void CardReader::removeFile(const char* name)
   }
     if (file.remove(curDir, fname))
     {
+      dirChanged();
       SERIAL_PROTOCOLPGM("File deleted:");
       SERIAL_PROTOCOL(fname);
       sdpos = 0;
@@ -414,6 +512,37 @@ void CardReader::getStatus()
     SERIAL_PROTOCOLLN(card.errorCode());
   }
 }
+#if SD_READ_BUFFER_SIZE > 0
+//Refill the read-ahead buffer with the bytes following it, up to the end of the current 512 byte block so a refill
+//never needs more than one block from the card. On a read error or at the end of the file the buffer is left as it was.
+bool CardReader::fillReadBuffer()
+{
+  uint32_t pos = readBufferPos + readLength;
+  uint16_t n = 512 - (pos & 0x1FF);
+  if (n > SD_READ_BUFFER_SIZE)
+    n = SD_READ_BUFFER_SIZE;
+  int16_t len = file.read(readBuffer, n);
+  if (len <= 0)
+    return false;
+  readBufferPos = pos;
+  readLength = len;
+  readIndex = 0;
+  return true;
+}
+#endif
+
+void CardReader::getCacheStats()
+{
+  SERIAL_PROTOCOLPGM("SD cache hits:");
+  SERIAL_PROTOCOL(SdVolume::cacheHits());
+  SERIAL_PROTOCOLPGM(" misses:");
+  SERIAL_PROTOCOL(SdVolume::cacheMisses());
+  SERIAL_PROTOCOLPGM(" FAT cache hits:");
+  SERIAL_PROTOCOL(SdVolume::fatCacheHits());
+  SERIAL_PROTOCOLPGM(" misses:");
+  SERIAL_PROTOCOLLN(SdVolume::fatCacheMisses());
+}
+
 void CardReader::write_command(char *buf)
 {
   char* begin = buf;
@@ -429,6 +558,15 @@ void CardReader::write_command(char *buf)
   end[1] = '\r';
   end[2] = '\n';
   end[3] = '\0';
+#if SD_WRITE_PREALLOCATE > 0
+  if (file.curPosition() + (end + 3 - begin) > writeReserved)
+  {
+    if (file.preallocate(SD_WRITE_PREALLOCATE))
+      writeReserved = file.curPosition() + SD_WRITE_PREALLOCATE;
+    else
+      writeReserved = 0xFFFFFFFF; //No contiguous space left, let write() add clusters one at a time.
+  }
+#endif
   file.write(begin);
   if (file.writeError)
   {
@@ -497,6 +635,11 @@ void CardReader::checkautostart(bool force)
 
 void CardReader::closefile()
 {
+#if SD_WRITE_PREALLOCATE > 0
+  //Free the reserved clusters after the end of the written data.
+  if (saving)
+    file.truncate(file.fileSize());
+#endif
   file.sync();
   file.close();
   saving = false;
@@ -504,10 +647,37 @@ void CardReader::closefile()
 }
 
 void CardReader::getfilename(const uint8_t nr)
+{
+#if SD_SORT_LIMIT > 0
+  if (nr < sortCount)
+  {
+    getfilenameUnsorted(sortOrder[nr]);
+    return;
+  }
+  if (sortCount > 0)
+  {
+    getfilenameUnsorted(sortUnselected(nr - sortCount));
+    return;
+  }
+#endif
+  getfilenameUnsorted(nr);
+}
+
+void CardReader::getfilenameUnsorted(const uint8_t nr)
 {
   curDir=&workDir;
   lsAction=LS_GetFilename;
   nrFiles=nr;
+#if SD_DIR_INDEX_SIZE > 0
+  uint8_t slot = nr / dirIndexStep;
+  if (slot < dirIndexCount)
+  {
+    //Start at the nearest indexed entry and only skip the entries after it.
+    nrFiles -= slot * dirIndexStep;
+    curDir->seekSet((uint32_t)dirIndex[slot] << 5);
+  }
+  else
+#endif
   curDir->rewind();
   lsDive("",*curDir);
 
@@ -518,12 +688,111 @@ uint16_t CardReader::getnrfilenames()
   curDir=&workDir;
   lsAction=LS_Count;
   nrFiles=0;
+  dirIndexClear();
   curDir->rewind();
   lsDive("",*curDir);
   //SERIAL_ECHOLN(nrFiles);
+#if SD_SORT_LIMIT > 0
+  uint16_t count = nrFiles;
+  if (card.errorCode())
+  {
+    sortCount = 0;
+  }
+  else if (sortStale || sortedMode != sortMode || sortFiles != count || sortDirCluster != workDir.firstCluster())
+  {
+    sortFilenames();
+  }
+  return count;
+#else
   return nrFiles;
+#endif
+}
+
+#if SD_SORT_LIMIT > 0
+//Is the entry (name, isDir, modified) listed before the entry last found by getfilenameUnsorted()?
+bool CardReader::sortBefore(const char* name, bool isDir, uint32_t modified)
+{
+  if (isDir != filenameIsDir)
+    return isDir;
+  if (sortMode == SORT_NEWEST && modified != fileModified)
+    return modified > fileModified;
+  return strcasecmp(name, longFilename[0] ? longFilename : filename) < 0;
+}
+
+//Select the SD_SORT_LIMIT entries of the working directory that are listed first, in one pass over the whole directory: the
+//first entries are binary insertion sorted, after that an entry is only inserted (dropping the last one) when it sorts before
+//the last sorted entry. Only the entry being inserted is kept in RAM, the entries it is compared with are read back from the
+//card (which the directory index keeps cheap).
+void CardReader::sortFilenames()
+{
+  uint16_t count = nrFiles;
+  sortCount = 0;
+  sortedMode = sortMode;
+  sortFiles = count;
+  sortDirCluster = workDir.firstCluster();
+  sortStale = false;
+  if (sortMode == SORT_NONE)
+    return;
+  //Listed entries are numbered with a byte.
+  if (count > 256)
+    count = 256;
+
+  char name[LONG_FILENAME_LENGTH];
+  uint8_t sorted = 0;
+  for(uint16_t i=0; i<count; i++)
+  {
+    getfilenameUnsorted(i);
+    strcpy(name, longFilename[0] ? longFilename : filename);
+    bool isDir = filenameIsDir;
+    uint32_t modified = fileModified;
+
+    if (sorted == SD_SORT_LIMIT)
+    {
+      getfilenameUnsorted(sortOrder[sorted - 1]);
+      if (!sortBefore(name, isDir, modified))
+        continue;
+      sorted--;
+    }
+    uint8_t lo = 0, hi = sorted;
+    while (lo < hi)
+    {
+      uint8_t mid = (lo + hi) / 2;
+      getfilenameUnsorted(sortOrder[mid]);
+      if (sortBefore(name, isDir, modified))
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+    memmove(&sortOrder[lo + 1], &sortOrder[lo], sorted - lo);
+    sortOrder[lo] = i;
+    sorted++;
+  }
+  if (card.errorCode())
+  {
+    sortStale = true;
+    return;
+  }
+  sortCount = sorted;
 }
 
+//Directory order number of the n-th entry that is not one of the sorted ones, those follow the sorted entries in directory order.
+uint8_t CardReader::sortUnselected(uint8_t n)
+{
+  uint16_t nr = n;
+  for(;;)
+  {
+    //Skip the sorted entries up to nr, which can move nr past more sorted entries.
+    uint16_t next = n;
+    for(uint8_t i=0; i<sortCount; i++)
+      if (sortOrder[i] <= nr)
+        next++;
+    if (next == nr)
+      return nr;
+    nr = next;
+  }
+}
+#endif
+
 void CardReader::chdir(const char * relpath)
 {
   SdFile newfile;
@@ -546,6 +815,7 @@ void CardReader::chdir(const char * relpath)
       workDirParents[0]=*parent;
     }
     workDir=newfile;
+    dirChanged();
   }
 }
 
@@ -557,10 +827,38 @@ void CardReader::updir()
     workDir = workDirParents[0];
     for (uint8_t d = 0; d < workDirDepth; d++)
       workDirParents[d] = workDirParents[d+1];
+    dirChanged();
   }
 }
 
 
+//Write the absolute path of the open file, a file in the working directory, to path. False when it does not fit in size characters.
+bool CardReader::getAbsFilename(char* path, uint8_t size)
+{
+  char name[13];
+  uint8_t len = 0;
+  //workDirParents[0] is the parent of workDir, workDirParents[workDirDepth-1] is the root.
+  for (uint8_t level = 1; level <= workDirDepth + 1; level++)
+  {
+    if (level <= workDirDepth)
+    {
+      SdFile* dir = (level == workDirDepth) ? &workDir : &workDirParents[workDirDepth - 1 - level];
+      if (!dir->getFilename(name))
+        return false;
+    }else if (!file.getFilename(name))
+    {
+      return false;
+    }
+    uint8_t n = strlen(name);
+    if (len + n + 2 > size)
+      return false;
+    path[len++] = '/';
+    strcpy(path + len, name);
+    len += n;
+  }
+  return true;
+}
+
 void CardReader::printingHasFinished()
 {
     st_synchronize();
@@ -568,6 +866,9 @@ void CardReader::printingHasFinished()
     file.close();
     sdprinting = false;
     pause = false;
+#ifdef PRINT_CHECKPOINT
+    print_checkpoint_clear();
+#endif
     if(SD_FINISHED_STEPPERRELEASE)
     {
         //finishAndDisableSteppers();
@@ -18,6 +18,7 @@
 
 #include "SdFile.h"
 enum LsAction {LS_SerialPrint,LS_Count,LS_GetFilename};
+enum SortMode {SORT_NONE,SORT_NAME,SORT_NEWEST};
 class CardReader
 {
 public:
@@ -38,10 +39,15 @@ public:
   void startFileprint();
   void pauseSDPrint();
   void getStatus();
+  void getCacheStats();
+  FORCE_INLINE void clearCacheStats() { SdVolume::cacheStatsClear(); }
   void printingHasFinished();
 
   void getfilename(const uint8_t nr);
   uint16_t getnrfilenames();
+#if SD_SORT_LIMIT > 0
+  FORCE_INLINE void setSortMode(uint8_t mode) { sortMode = mode; }
+#endif
 
 
   void ls();
@@ -52,14 +58,38 @@ public:
 
   FORCE_INLINE bool isFileOpen() { return file.isOpen(); }
   FORCE_INLINE bool eof() { return sdpos>=filesize ;};
+#if SD_READ_BUFFER_SIZE > 0
+  FORCE_INLINE int16_t get()
+  {
+    if (readIndex >= readLength && !fillReadBuffer())
+    {
+      sdpos = readBufferPos + readLength;
+      return -1;
+    }
+    sdpos = readBufferPos + readIndex;
+    return (uint8_t)readBuffer[readIndex++];
+  }
+  FORCE_INLINE int16_t fgets(char* str, int16_t num)
+  {
+    file.seekSet(readBufferPos + readIndex);
+    int16_t n = file.fgets(str, num, NULL);
+    readBufferPos = file.curPosition();
+    readLength = readIndex = 0;
+    return n;
+  }
+  FORCE_INLINE void setIndex(long index) {sdpos = index;file.seekSet(index);readBufferPos = index;readLength = readIndex = 0;};
+#else
   FORCE_INLINE int16_t get() {  sdpos = file.curPosition();return (int16_t)file.read();};
   FORCE_INLINE int16_t fgets(char* str, int16_t num) { return file.fgets(str, num, NULL); }
   FORCE_INLINE void setIndex(long index) {sdpos = index;file.seekSet(index);};
+#endif
   FORCE_INLINE uint8_t percentDone(){if(!isFileOpen()) return 0; if(filesize) return sdpos/((filesize+99)/100); else return 0;};
   FORCE_INLINE char* getWorkDirName(){workDir.getFilename(filename);return filename;};
   FORCE_INLINE bool atRoot() { return workDirDepth==0; }
   FORCE_INLINE uint32_t getFilePos() { return sdpos; }
   FORCE_INLINE uint32_t getFileSize() { return filesize; }
+  FORCE_INLINE uint32_t getFileCluster() { return file.firstCluster(); }
+  bool getAbsFilename(char* path, uint8_t size);
   FORCE_INLINE bool isOk() { return cardOK && card.errorCode() == 0; }
   FORCE_INLINE int errorCode() { return card.errorCode(); }
   FORCE_INLINE void clearError() { card.error(0); }
@@ -83,9 +113,16 @@ public:
   bool sdprinting;
   bool pause;
   bool sdInserted;
+#ifdef BINARY_GCODE
+  bool binaryFile;
+#endif
   char filename[13];
   char longFilename[LONG_FILENAME_LENGTH];
   bool filenameIsDir;
+  //First cluster, size and last write date/time of the entry found by getfilename(), which together identify its contents.
+  uint32_t fileCluster;
+  uint32_t fileLength;
+  uint32_t fileModified;
   int lastnr; //last number of the autostart;
 private:
   bool cardOK;
@@ -99,6 +136,43 @@ private:
   //int16_t n;
   unsigned long autostart_atmillis;
   uint32_t sdpos ;
+#if SD_WRITE_PREALLOCATE > 0
+  uint32_t writeReserved; //file position up to which clusters are reserved for the file being written
+#endif
+#if SD_READ_BUFFER_SIZE > 0
+  //Read-ahead buffer for get(), holding readLength bytes from file position readBufferPos, of which readIndex are used.
+  char readBuffer[SD_READ_BUFFER_SIZE];
+  uint32_t readBufferPos;
+  uint16_t readLength;
+  uint16_t readIndex;
+  bool fillReadBuffer();
+#endif
+#if SD_DIR_INDEX_SIZE > 0
+  //Directory entry number (position / 32) of listed entry 0, dirIndexStep, 2*dirIndexStep... of workDir. Empty when dirIndexCount is 0.
+  uint16_t dirIndex[SD_DIR_INDEX_SIZE];
+  uint8_t dirIndexCount;
+  uint16_t dirIndexStep;
+  void dirIndexAdd(uint32_t pos);
+  FORCE_INLINE void dirIndexClear() { dirIndexCount = 0; dirIndexStep = 1; }
+#else
+  FORCE_INLINE void dirIndexClear() {}
+#endif
+#if SD_SORT_LIMIT > 0
+  //sortOrder[n] is the directory order number of sorted entry n, for the sortCount entries of directory sortDirCluster that are
+  //listed first. The other entries follow them in directory order.
+  uint8_t sortOrder[SD_SORT_LIMIT];
+  uint8_t sortCount;
+  uint8_t sortMode;
+  uint8_t sortedMode;
+  bool sortStale;
+  uint16_t sortFiles;
+  uint32_t sortDirCluster;
+  void sortFilenames();
+  bool sortBefore(const char* name, bool isDir, uint32_t modified);
+  uint8_t sortUnselected(uint8_t n);
+#endif
+  void getfilenameUnsorted(const uint8_t nr);
+  void dirChanged();
 
   bool autostart_stilltocheck; //the sd start is delayed, because otherwise the serial cannot answer fast enought to make contact with the hostsoftware.
 
@@ -0,0 +1,126 @@
+#!/usr/bin/env python
+
+""" Convert an ASCII G-code file to the binary G-code frames that the firmware prints from SD (BINARY_GCODE).
+
+G0/G1 lines with nothing but X, Y, Z, E and F become move frames, every other command becomes a text frame. The frame
+format is described in binary_gcode.h: 0xA5, sequence number, type, payload length, payload, CRC16 low and high byte,
+with the CRC16 (CCITT, start value 0xFFFF) over everything after the 0xA5. Move values are rounded to 1/1000mm for
+X, Y and Z, 1/10000mm for E and whole mm/min for F. Axes that moved less than 32.767mm (3.2767mm for E) since the previous
+move frame are written as int16 steps (BINARY_GCODE_MOVE_DELTA), when all axes of the move fit.
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+SYNC = 0xA5
+
+FRAME_MOVE = 1
+FRAME_TEXT = 2
+
+MOVE_F = 1 << 4
+MOVE_G0 = 1 << 5
+MOVE_DELTA = 1 << 6
+
+AXES = "XYZE"
+AXIS_SCALE = [1000, 1000, 1000, 10000]
+
+MAX_CMD_SIZE = 96
+
+WORD = re.compile(r"([A-Z])\s*([-+]?(?:[0-9]+\.?[0-9]*|\.[0-9]+))")
+
+def crc16(data):
+    "CRC16 CCITT as crc16_update() in binary_gcode.cpp computes it"
+    crc = 0xFFFF
+    for c in bytearray(data):
+        crc ^= c << 8
+        for n in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xFFFF
+            else:
+                crc = (crc << 1) & 0xFFFF
+    return crc
+
+class Converter:
+    "Turns G-code lines into frames, keeping the axis values the decoder builds delta moves on"
+    def __init__(self):
+        self.sequence = 0
+        self.last_position = [0, 0, 0, 0] # Same start as binary_gcode_reset()
+        self.moves = 0
+        self.texts = 0
+
+    def frame(self, type, payload):
+        body = bytearray([self.sequence, type, len(payload)]) + payload
+        self.sequence = (self.sequence + 1) & 0xFF
+        crc = crc16(body)
+        return bytearray([SYNC]) + body + bytearray([crc & 0xFF, crc >> 8])
+
+    def move(self, code, words):
+        "Move frame for G0/G1 with the given (letter, value) words, None when the move needs the text form"
+        flags = MOVE_G0 if code == 0 else 0
+        values = [None] * len(AXES)
+        feedrate = None
+        for letter, value in words:
+            if letter in AXES:
+                axis = AXES.index(letter)
+                if values[axis] is not None:
+                    return None
+                values[axis] = int(round(float(value) * AXIS_SCALE[axis]))
+                if not -0x80000000 <= values[axis] <= 0x7FFFFFFF:
+                    return None
+                flags |= 1 << axis
+            elif letter == "F" and feedrate is None:
+                feedrate = int(round(float(value)))
+                if not 0 <= feedrate <= 0xFFFF:
+                    return None
+                flags |= MOVE_F
+            else:
+                return None
+        delta = all(values[axis] is None or -0x8000 <= values[axis] - self.last_position[axis] <= 0x7FFF for axis in range(len(AXES)))
+        payload = bytearray([flags | (MOVE_DELTA if delta else 0)])
+        for axis in range(len(AXES)):
+            if values[axis] is None:
+                continue
+            if delta:
+                payload += struct.pack("<h", values[axis] - self.last_position[axis])
+            else:
+                payload += struct.pack("<i", values[axis])
+            self.last_position[axis] = values[axis]
+        if feedrate is not None:
+            payload += struct.pack("<H", feedrate)
+        self.moves += 1
+        return self.frame(FRAME_MOVE, payload)
+
+    def line(self, line, number):
+        "Frames for one line of G-code, empty for lines without a command"
+        command = line.split(";", 1)[0].split("*", 1)[0].strip()
+        command = re.sub(r"^N\s*[0-9]+\s*", "", command)
+        if command == "":
+            return bytearray()
+        words = WORD.findall(command.upper())
+        if len(words) > 0 and words[0][0] == "G" and words[0][1] in ("0", "1", "00", "01"):
+            # Only when the whole line is these words, anything else goes as text.
+            if WORD.sub("", command.upper()).strip() == "":
+                frame = self.move(int(words[0][1]), words[1:])
+                if frame is not None:
+                    return frame
+        if len(command) > MAX_CMD_SIZE - 1:
+            raise ValueError("line %d: command longer than %d characters" % (number, MAX_CMD_SIZE - 1))
+        self.texts += 1
+        return self.frame(FRAME_TEXT, bytearray(command.encode("ascii")))
+
+parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+parser.add_argument('input', help='ASCII G-code file')
+parser.add_argument('output', help='binary G-code file to write')
+args = parser.parse_args()
+
+converter = Converter()
+size = 0
+with open(args.input, "r") as input:
+    with open(args.output, "wb") as output:
+        for number, line in enumerate(input, 1):
+            data = converter.line(line, number)
+            size += len(data)
+            output.write(data)
+sys.stderr.write("%d move frames, %d text frames, %d bytes\n" % (converter.moves, converter.texts, size))
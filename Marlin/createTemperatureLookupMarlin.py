@@ -20,11 +20,21 @@ Options:
   --t1=ttt:rrr      middle temperature temperature:resistance point (around 150C)
   --t2=ttt:rrr      high temperature temperature:resistance point (around 250C)
   --num-temps=...   the number of temperature points to calculate (default: 20)
+  --indexed=...     read the tables from the given thermistortables.h and write the direct indexed
+                    tables for thermistortables_indexed.h (one entry per ADC value, in 1/16 degree C)
+  --check-indexed=...
+                    check thermistortables_indexed.h next to the given thermistortables.h against the
+                    linear tables for every raw value, fails when one is off by more than 0.1 degree C
 """
 
 from math import *
 import sys
 import getopt
+import re
+import os
+
+INDEXED_FRACTION_BITS = 4
+INDEXED_MAX_ERROR = 0.1
 
 class Thermistor:
     "Class to do the thermistor maths"
@@ -69,6 +79,137 @@ class Thermistor:
         r = exp(pow(x-y,1.0/3) - pow(x+y,1.0/3)) # resistance of thermistor
         return (r / (self.rp + r)) * (1024*16)
 
+def table_temp(table, raw):
+    "Convert an oversampled ADC value to a temperature the same way analog2temp() does with the linear table"
+    for i in range(1, len(table)):
+        if table[i][0] > raw:
+            return table[i-1][1] + (raw - table[i-1][0]) * float(table[i][1] - table[i-1][1]) / float(table[i][0] - table[i-1][0])
+    return table[-1][1]
+
+def table_search_length(table, raw):
+    "Number of table entries analog2temp() reads before it finds the pair around raw"
+    for i in range(1, len(table)):
+        if table[i][0] > raw:
+            return i
+    return len(table) - 1
+
+def indexed_temp(values, raw, oversample):
+    "Convert an oversampled ADC value with an indexed table in the integer math of indexed2temp()"
+    n = raw // oversample
+    temp = values[n]
+    if raw % oversample:
+        # C integer division truncates towards zero
+        temp = temp + int(float((values[n+1] - temp) * (raw % oversample)) / oversample)
+    return float(temp) / (1 << INDEXED_FRACTION_BITS)
+
+def linear_tables(src):
+    "The tables in thermistortables.h as (condition, number, [(raw, temp), ...])"
+    tables = []
+    for m in re.finditer(r'#if ([^\n]*)\n(?:[^\n]*\n)*?const short temptable_(\d+)\[\]\[2\] PROGMEM = \{(.*?)\};', src, re.S):
+        body = re.sub(r'//.*', '', m.group(3))
+        table = [(int(raw) * oversample_count(src), int(temp)) for raw, temp in re.findall(r'\{\s*(\d+)\s*\*\s*OVERSAMPLENR\s*,\s*(-?\d+)\s*\}', body)]
+        tables.append((m.group(1).split('//')[0].strip(), m.group(2), table))
+    return tables
+
+def oversample_count(src):
+    return int(re.search(r'#define OVERSAMPLENR (\d+)', src).group(1))
+
+def indexed_error(table, values, oversample):
+    "Largest difference between the indexed and the linear table over every raw value"
+    return max([abs(indexed_temp(values, raw, oversample) - table_temp(table, raw)) for raw in range(1024 * oversample)])
+
+def indexed_tables(filename):
+    "Resample every table in thermistortables.h to one entry per ADC value"
+    src = open(filename).read()
+    oversample = oversample_count(src)
+    print "// Direct indexed thermistor tables for Marlin, generated from thermistortables.h with:"
+    print "// ./createTemperatureLookupMarlin.py --indexed=thermistortables.h > thermistortables_indexed.h"
+    print "// Entry n is the temperature in 1/%d degree C at raw value n*OVERSAMPLENR, analog2temp() interpolates in between." % (1 << INDEXED_FRACTION_BITS)
+    print "// A table that can not be resampled within %.1f C is left out, analog2temp() searches the linear table for it." % (INDEXED_MAX_ERROR)
+    print "// Regenerate this file after changing a table or OVERSAMPLENR in thermistortables.h, check it with:"
+    print "// ./createTemperatureLookupMarlin.py --check-indexed=thermistortables.h"
+    print "#ifndef THERMISTORTABLES_INDEXED_H_"
+    print "#define THERMISTORTABLES_INDEXED_H_"
+    print ""
+    print "#if OVERSAMPLENR != %d" % (oversample)
+    print "#error thermistortables_indexed.h was generated for OVERSAMPLENR %d, regenerate it" % (oversample)
+    print "#endif"
+    print ""
+    print "#define TEMPTABLE_INDEXED_LEN %d" % (1024 + 1)
+    print "#define TEMPTABLE_INDEXED_FRACTION_BITS %d" % (INDEXED_FRACTION_BITS)
+    excluded = []
+    for condition, number, table in linear_tables(src):
+        values = [int(round(table_temp(table, n * oversample) * (1 << INDEXED_FRACTION_BITS))) for n in range(1024 + 1)]
+        error = indexed_error(table, values, oversample)
+        print ""
+        if error > INDEXED_MAX_ERROR:
+            print "// temptable_%s is not indexed, max deviation %.3f C: the table has a step that can not be interpolated." % (number, error)
+            excluded.append(number)
+            continue
+        print "#if %s" % (condition)
+        print "// Max deviation from temptable_%s: %.3f C" % (number, error)
+        print "const short temptable_%s_indexed[TEMPTABLE_INDEXED_LEN] PROGMEM = {" % (number)
+        for n in range(0, len(values), 16):
+            line = ", ".join(["%d" % v for v in values[n:n+16]])
+            if n + 16 < len(values):
+                line = line + ","
+            print "  " + line
+        print "};"
+        print "#endif"
+    print ""
+    print "#define _TT_INDEXED_NAME(_N) temptable_ ## _N ## _indexed"
+    print "#define TT_INDEXED_NAME(_N) _TT_INDEXED_NAME(_N)"
+    for heater, define in (("HEATER_0", "THERMISTORHEATER_0"), ("HEATER_1", "THERMISTORHEATER_1"), ("HEATER_2", "THERMISTORHEATER_2"), ("BED", "THERMISTORBED")):
+        name = heater == "BED" and "BEDTEMPTABLE_INDEXED" or "%s_TEMPTABLE_INDEXED" % (heater)
+        print ""
+        print "#if defined(%s)%s" % (define, "".join([" && %s != %s" % (define, number) for number in excluded]))
+        print "# define %s TT_INDEXED_NAME(%s)" % (name, define)
+        if heater != "BED":
+            print "#else"
+            print "# define %s NULL" % (name)
+        print "#endif"
+    print ""
+    print "#endif //THERMISTORTABLES_INDEXED_H_"
+
+def check_indexed(filename):
+    "Compare the indexed tables in thermistortables_indexed.h against the linear tables for every raw value"
+    src = open(filename).read()
+    oversample = oversample_count(src)
+    indexed = open(os.path.join(os.path.dirname(filename), "thermistortables_indexed.h")).read()
+    failed = False
+    m = re.search(r'#if OVERSAMPLENR != (\d+)', indexed)
+    if m is None or int(m.group(1)) != oversample:
+        print "thermistortables_indexed.h is not generated for OVERSAMPLENR %d" % (oversample)
+        failed = True
+    print "table  max error  search reads avg/max"
+    for condition, number, table in linear_tables(src):
+        m = re.search(r'const short temptable_%s_indexed\[TEMPTABLE_INDEXED_LEN\] PROGMEM = \{(.*?)\};' % (number), indexed, re.S)
+        lengths = [table_search_length(table, raw) for raw in range(1024 * oversample)]
+        if m is None:
+            if not re.search(r'&& THERMISTORHEATER_0 != %s\b' % (number), indexed):
+                print "temptable_%s has no indexed table and no fallback" % (number)
+                failed = True
+            print "%5s  not indexed  %.1f/%d" % (number, float(sum(lengths)) / len(lengths), max(lengths))
+            continue
+        values = [int(v) for v in re.findall(r'-?\d+', m.group(1))]
+        error = 0
+        if len(values) != 1024 + 1:
+            print "temptable_%s_indexed has %d entries" % (number, len(values))
+            failed = True
+        else:
+            error = indexed_error(table, values, oversample)
+            # indexed2temp() multiplies the difference of two entries with the remainder in 16 bit
+            if max([abs(values[n+1] - values[n]) * (oversample - 1) for n in range(1024)]) > 32767:
+                print "temptable_%s_indexed overflows the interpolation" % (number)
+                failed = True
+        if error > INDEXED_MAX_ERROR:
+            failed = True
+        print "%5s  %7.3f C  %.1f/%d" % (number, error, float(sum(lengths)) / len(lengths), max(lengths))
+    if failed:
+        print "FAILED"
+        sys.exit(1)
+    print "OK, indexed2temp() reads 2 entries for every raw value"
+
 def main(argv):
 
     rp = 4700;
@@ -81,7 +222,7 @@ def main(argv):
     num_temps = int(36);
 
     try:
-        opts, args = getopt.getopt(argv, "h", ["help", "rp=", "t1=", "t2=", "t3=", "num-temps="])
+        opts, args = getopt.getopt(argv, "h", ["help", "rp=", "t1=", "t2=", "t3=", "num-temps=", "indexed=", "check-indexed="])
     except getopt.GetoptError:
         usage()
         sys.exit(2)
@@ -106,6 +247,12 @@ def main(argv):
             r3 = float( arg[1])
         elif opt == "--num-temps":
             num_temps =  int(arg)
+        elif opt == "--indexed":
+            indexed_tables(arg)
+            sys.exit()
+        elif opt == "--check-indexed":
+            check_indexed(arg)
+            sys.exit()
 
     max_adc = (1024 * 16) - 1
     min_temp = 0
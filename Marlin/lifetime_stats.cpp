@@ -12,7 +12,8 @@
 
 //Normal configuration from ConfigurationStore.cpp is stored at offset 100 (not 0x100), and has an undefined length.
 //Material profiles are stored at 0x800 and is currently 385 bytes long.
-//Storing the lifetime stats at 0x700 gives 256 bytes of storage that should be safe to use.
+//Storing the lifetime stats at 0x700 gives 256 bytes of storage that should be safe to use. The stats take the first 28 bytes,
+// the learned heating rates from temperature.cpp are stored at 0x780.
 #define LIFETIME_EEPROM_OFFSET 0x700
 
 static unsigned long startup_millis;
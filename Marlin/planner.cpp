@@ -56,6 +56,7 @@
 #include "stepper.h"
 #include "temperature.h"
 #include "lifetime_stats.h"
+#include "print_checkpoint.h"
 #include "ultralcd.h"
 #include "UltiLCD2.h"
 #include "language.h"
@@ -90,12 +91,19 @@ float autotemp_factor=0.1;
 bool autotemp_enabled=false;
 #endif
 
+#ifdef DYNAMIC_MICROSTEPPING
+bool dynamic_microstepping_enabled=true;
+#endif
+
 //===========================================================================
 //=================semi-private variables, used in inline  functions    =====
 //===========================================================================
 block_t block_buffer[BLOCK_BUFFER_SIZE];            // A ring buffer for motion instfructions
 volatile unsigned char block_buffer_head;           // Index of the next block to be pushed
 volatile unsigned char block_buffer_tail;           // Index of the block to process now
+#ifdef PRINT_CHECKPOINT
+volatile unsigned char plan_blocks_finished;
+#endif
 
 //===========================================================================
 //=============================private variables ============================
@@ -110,6 +118,9 @@ static unsigned char old_direction_bits = 0;               // Old direction bits
 static long x_segment_time[3]={MAX_FREQ_TIME + 1,0,0};     // Segment times (in us). Used for speed calculations
 static long y_segment_time[3]={MAX_FREQ_TIME + 1,0,0};
 #endif
+#ifdef DYNAMIC_MICROSTEPPING
+static unsigned char next_microstep_axes = 0;              // Coarse microstep axes for the block being buffered
+#endif
 
 // Returns the index of the next block in the ring buffer
 // NOTE: Removed modulo (%) operator, which uses an expensive divide and multiplication.
@@ -514,6 +525,18 @@ void check_axes_activity()
 }
 
 
+#ifdef DYNAMIC_MICROSTEPPING
+// Round a position in steps to the coarse microstep grid of an axis, up or down.
+static long microstep_align(long steps, int8_t axis, bool up)
+{
+  const long mask = (1L << DYNAMIC_MICROSTEP_SHIFT) - 1;
+  steps += microstep_phase_offset[axis];
+  if (up)
+    steps += mask;
+  return (steps & ~mask) - microstep_phase_offset[axis];
+}
+#endif
+
 float junction_deviation = 0.1;
 // Add a new linear movement to the buffer. steps_x, _y and _z is the absolute position in
 // mm. Microseconds specify how many microseconds the move should take to perform. To aid acceleration
@@ -531,6 +554,9 @@ void plan_buffer_line(const float &x, const float &y, const float &z, const floa
     manage_inactivity();
     lcd_update();
     lifetime_stats_tick();
+#ifdef PRINT_CHECKPOINT
+    print_checkpoint_tick();
+#endif
   }
 
   // The target position of the tool in absolute steps
@@ -542,6 +568,47 @@ void plan_buffer_line(const float &x, const float &y, const float &z, const floa
   target[Z_AXIS] = lround(z*axis_steps_per_unit[Z_AXIS]);
   target[E_AXIS] = lround(e*axis_steps_per_unit[E_AXIS]*volume_to_filament_length[extruder]);
 
+  #ifdef DYNAMIC_MICROSTEPPING
+  if (dynamic_microstepping_enabled && next_microstep_axes == 0 && feed_rate >= DYNAMIC_MICROSTEP_MIN_FEEDRATE
+    && target[Z_AXIS] == position[Z_AXIS] && target[E_AXIS] == position[E_AXIS])
+  {
+    // Split the travel move in a fine head up to the coarse step grid, a coarse body and a fine tail.
+    // The drivers only change microstep mode on a full coarse step, so count_position stays exact.
+    long start[2], end[2];
+    unsigned char axes = 0;
+    unsigned char coarse_axes = microstep_coarse_axes();
+    float body_mm = 0;
+    for(int8_t i=X_AXIS; i <= Y_AXIS; i++)
+    {
+      bool up = target[i] > position[i];
+      start[i] = microstep_align(position[i], i, up);
+      end[i] = microstep_align(target[i], i, !up);
+      if ((coarse_axes & (1<<i)) && (up ? (end[i] > start[i]) : (end[i] < start[i])))
+      {
+        axes |= (1<<i);
+        body_mm += square((end[i] - start[i]) / axis_steps_per_unit[i]);
+      }
+      else
+      {
+        // Too short to gain anything, this axis stays in fine mode and does its move during the body.
+        start[i] = position[i];
+        end[i] = target[i];
+      }
+    }
+    if (axes != 0 && body_mm >= square(DYNAMIC_MICROSTEP_MIN_LENGTH))
+    {
+      if (start[X_AXIS] != position[X_AXIS] || start[Y_AXIS] != position[Y_AXIS])
+        plan_buffer_line(start[X_AXIS] / axis_steps_per_unit[X_AXIS], start[Y_AXIS] / axis_steps_per_unit[Y_AXIS], z, e, feed_rate, extruder);
+      next_microstep_axes = axes;
+      plan_buffer_line(end[X_AXIS] / axis_steps_per_unit[X_AXIS], end[Y_AXIS] / axis_steps_per_unit[Y_AXIS], z, e, feed_rate, extruder);
+      next_microstep_axes = 0;
+      if (end[X_AXIS] != target[X_AXIS] || end[Y_AXIS] != target[Y_AXIS])
+        plan_buffer_line(x, y, z, e, feed_rate, extruder);
+      return;
+    }
+  }
+  #endif//DYNAMIC_MICROSTEPPING
+
   #ifdef PREVENT_DANGEROUS_EXTRUDE
   if(target[E_AXIS]!=position[E_AXIS])
   {
@@ -584,6 +651,12 @@ block->steps_y = labs((target[X_AXIS]-position[X_AXIS]) - (target[Y_AXIS]-positi
   block->steps_e = labs(target[E_AXIS]-position[E_AXIS]);
   block->steps_e *= extrudemultiply[extruder];
   block->steps_e /= 100;
+#ifdef DYNAMIC_MICROSTEPPING
+  // The coarse axes are aligned to the coarse step grid by the split above, so this shift is exact.
+  block->microstep_axes = next_microstep_axes;
+  if (next_microstep_axes & (1<<X_AXIS)) block->steps_x >>= DYNAMIC_MICROSTEP_SHIFT;
+  if (next_microstep_axes & (1<<Y_AXIS)) block->steps_y >>= DYNAMIC_MICROSTEP_SHIFT;
+#endif
   block->step_event_count = max(block->steps_x, max(block->steps_y, max(block->steps_z, block->steps_e)));
 
   // Bail if this is a zero-length block
@@ -778,11 +851,17 @@ block->steps_y = labs((target[X_AXIS]-position[X_AXIS]) - (target[Y_AXIS]-positi
   else
   {
     block->acceleration_st = ceil(acceleration * steps_per_mm); // convert to: acceleration steps/sec^2
+    unsigned long x_steps_per_sqr_second = axis_steps_per_sqr_second[X_AXIS];
+    unsigned long y_steps_per_sqr_second = axis_steps_per_sqr_second[Y_AXIS];
+#ifdef DYNAMIC_MICROSTEPPING
+    if (block->microstep_axes & (1<<X_AXIS)) x_steps_per_sqr_second >>= DYNAMIC_MICROSTEP_SHIFT;
+    if (block->microstep_axes & (1<<Y_AXIS)) y_steps_per_sqr_second >>= DYNAMIC_MICROSTEP_SHIFT;
+#endif
     // Limit acceleration per axis
-    if(((float)block->acceleration_st * (float)block->steps_x / (float)block->step_event_count) > axis_steps_per_sqr_second[X_AXIS])
-      block->acceleration_st = axis_steps_per_sqr_second[X_AXIS];
-    if(((float)block->acceleration_st * (float)block->steps_y / (float)block->step_event_count) > axis_steps_per_sqr_second[Y_AXIS])
-      block->acceleration_st = axis_steps_per_sqr_second[Y_AXIS];
+    if(((float)block->acceleration_st * (float)block->steps_x / (float)block->step_event_count) > x_steps_per_sqr_second)
+      block->acceleration_st = x_steps_per_sqr_second;
+    if(((float)block->acceleration_st * (float)block->steps_y / (float)block->step_event_count) > y_steps_per_sqr_second)
+      block->acceleration_st = y_steps_per_sqr_second;
     if(((float)block->acceleration_st * (float)block->steps_e / (float)block->step_event_count) > axis_steps_per_sqr_second[E_AXIS])
       block->acceleration_st = axis_steps_per_sqr_second[E_AXIS];
     if(((float)block->acceleration_st * (float)block->steps_z / (float)block->step_event_count ) > axis_steps_per_sqr_second[Z_AXIS])
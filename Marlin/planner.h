@@ -37,6 +37,9 @@ typedef struct {
   long acceleration_rate;                   // The acceleration rate used for acceleration calculation
   unsigned char direction_bits;             // The direction bit set for this block (refers to *_DIRECTION_BIT in config.h)
   unsigned char active_extruder;            // Selects the active extruder
+  #ifdef DYNAMIC_MICROSTEPPING
+    unsigned char microstep_axes;           // X/Y axis bits stepped in coarse microstep mode, steps_x/steps_y are in coarse steps
+  #endif
   #ifdef ADVANCE
     long advance_rate;
     volatile long initial_advance;
@@ -97,6 +100,10 @@ extern float max_e_jerk;
 extern float mintravelfeedrate;
 extern unsigned long axis_steps_per_sqr_second[NUM_AXIS];
 
+#ifdef DYNAMIC_MICROSTEPPING
+    extern bool dynamic_microstepping_enabled;
+#endif
+
 #ifdef AUTOTEMP
     extern bool autotemp_enabled;
     extern float autotemp_max;
@@ -110,12 +117,18 @@ extern unsigned long axis_steps_per_sqr_second[NUM_AXIS];
 extern block_t block_buffer[BLOCK_BUFFER_SIZE];            // A ring buffer for motion instfructions
 extern volatile unsigned char block_buffer_head;           // Index of the next block to be pushed
 extern volatile unsigned char block_buffer_tail;
+#ifdef PRINT_CHECKPOINT
+extern volatile unsigned char plan_blocks_finished;        // Counts the discarded blocks, wrapping around
+#endif
 // Called when the current block is no longer needed. Discards the block and makes the memory
 // availible for new blocks.
 FORCE_INLINE void plan_discard_current_block()
 {
   if (block_buffer_head != block_buffer_tail) {
     block_buffer_tail = (block_buffer_tail + 1) & (BLOCK_BUFFER_SIZE - 1);
+#ifdef PRINT_CHECKPOINT
+    plan_blocks_finished++;
+#endif
   }
 }
 
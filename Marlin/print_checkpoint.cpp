@@ -0,0 +1,379 @@
+#include <avr/eeprom.h>
+#include <stddef.h>
+#include "Marlin.h"
+#include "planner.h"
+#include "temperature.h"
+#include "cardreader.h"
+#include "print_checkpoint.h"
+
+#ifdef PRINT_CHECKPOINT
+
+//The material change settings end below 0x480 and the lifetime stats start at 0x700. The checkpoints use the space
+//in between: a header at 0x480, followed by slots that are written in turn so the wear is spread over all of them.
+//EEPROM has a 100.000 erase cycles garantee. With one extruder there are 9 slots, so with a checkpoint every minute
+//each slot is written once per 9 minutes of printing, which lasts 15.000 hours of printing. Bytes that did not
+//change are not written at all.
+#define PRINT_CHECKPOINT_EEPROM_OFFSET 0x480
+#define PRINT_CHECKPOINT_EEPROM_END 0x700
+#define PRINT_CHECKPOINT_HEADER_SIZE 0x40
+#define PRINT_CHECKPOINT_SLOTS ((PRINT_CHECKPOINT_EEPROM_END - PRINT_CHECKPOINT_EEPROM_OFFSET - PRINT_CHECKPOINT_HEADER_SIZE) / sizeof(print_checkpoint_t))
+#define PRINT_CHECKPOINT_SLOT_OFFSET(n) (PRINT_CHECKPOINT_EEPROM_OFFSET + PRINT_CHECKPOINT_HEADER_SIZE + uint16_t(n) * sizeof(print_checkpoint_t))
+
+//Header: whether a print is running, which print it is, and the first cluster, size and path of its file. The path has
+//its own checksum, it is written once per print and not covered by the checkpoint checksums.
+#define HEADER_ACTIVE_OFFSET   ((uint8_t*)(PRINT_CHECKPOINT_EEPROM_OFFSET + 0))
+#define HEADER_PRINT_ID_OFFSET ((uint8_t*)(PRINT_CHECKPOINT_EEPROM_OFFSET + 1))
+#define HEADER_CLUSTER_OFFSET  ((uint32_t*)(PRINT_CHECKPOINT_EEPROM_OFFSET + 2))
+#define HEADER_SIZE_OFFSET     ((uint32_t*)(PRINT_CHECKPOINT_EEPROM_OFFSET + 6))
+#define HEADER_PATH_OFFSET     ((uint8_t*)(PRINT_CHECKPOINT_EEPROM_OFFSET + 10))
+#define HEADER_PATH_CHECKSUM_OFFSET ((uint8_t*)(PRINT_CHECKPOINT_EEPROM_OFFSET + 10 + PRINT_CHECKPOINT_PATH_LENGTH))
+#define HEADER_ACTIVE 'P'
+
+#define STATE_OFF     0 //No print running, or its file can not be resumed
+#define STATE_IDLE    1 //Waiting for the next checkpoint time
+#define STATE_ARMED   2 //The next command read from the file gets marked
+#define STATE_MARKED  3 //Waiting until the marked command is processed
+#define STATE_WAITING 4 //Waiting until the moves queued in front of the marked command are finished
+#define STATE_WRITING 5 //Writing the checkpoint, a byte whenever the EEPROM is ready
+
+static uint8_t state = STATE_OFF;
+static print_checkpoint_t checkpoint;//The checkpoint being taken, or the newest one found at startup
+static uint8_t print_id;
+static uint8_t next_slot;
+static uint8_t write_index;
+static uint8_t blocks_target;        //plan_blocks_finished once the moves in front of the marked command are finished
+static unsigned long next_checkpoint_millis;
+static bool resume_available;
+static bool resume_return;           //A resume is waiting for M413 R to move back to the checkpoint
+
+//Cost of taking and writing the checkpoints, reported by M413.
+static uint16_t checkpoint_count;
+static unsigned long checkpoint_micros;
+static uint16_t checkpoint_max_micros;
+
+static uint8_t checkpoint_checksum(const print_checkpoint_t* cp)
+{
+    uint8_t sum = 0;
+    for(uint8_t n=0; n<offsetof(print_checkpoint_t, checksum); n++)
+        sum += ((const uint8_t*)cp)[n];
+    return ~sum;
+}
+
+static uint8_t path_checksum(const char* path)
+{
+    uint8_t sum = 0;
+    while(*path)
+        sum += *path++;
+    return ~sum;
+}
+
+//Read the path of the file of the checkpoint, false (and an empty path) when it is not a terminated absolute path
+//with the checksum written by print_checkpoint_start().
+static bool read_path(char* path)
+{
+    eeprom_read_block(path, HEADER_PATH_OFFSET, PRINT_CHECKPOINT_PATH_LENGTH);
+    if (path[0] != '/' || !memchr(path, '\0', PRINT_CHECKPOINT_PATH_LENGTH) || eeprom_read_byte(HEADER_PATH_CHECKSUM_OFFSET) != path_checksum(path))
+    {
+        path[0] = '\0';
+        return false;
+    }
+    return true;
+}
+
+static void checkpoint_cost(unsigned long start)
+{
+    unsigned long t = micros() - start;
+    checkpoint_micros += t;
+    if (t > checkpoint_max_micros)
+        checkpoint_max_micros = t;
+}
+
+//Blocking write of the bytes that differ from what is stored.
+static void eeprom_write_changed(uint8_t* address, const void* data, uint8_t size)
+{
+    for(uint8_t n=0; n<size; n++)
+        if (eeprom_read_byte(address + n) != ((const uint8_t*)data)[n])
+            eeprom_write_byte(address + n, ((const uint8_t*)data)[n]);
+}
+
+void print_checkpoint_init()
+{
+    print_checkpoint_t slot;
+    char path[PRINT_CHECKPOINT_PATH_LENGTH];
+    int8_t newest = -1;
+
+    print_id = eeprom_read_byte(HEADER_PRINT_ID_OFFSET);
+    checkpoint.sequence = 0;
+    for(uint8_t n=0; n<PRINT_CHECKPOINT_SLOTS; n++)
+    {
+        eeprom_read_block(&slot, (void*)PRINT_CHECKPOINT_SLOT_OFFSET(n), sizeof(slot));
+        if (slot.checksum != checkpoint_checksum(&slot))
+            continue;
+        if (newest < 0 || int16_t(slot.sequence - checkpoint.sequence) > 0)
+        {
+            checkpoint = slot;
+            newest = n;
+        }
+    }
+    next_slot = (newest + 1) % PRINT_CHECKPOINT_SLOTS;
+    resume_available = newest >= 0 && checkpoint.print_id == print_id && eeprom_read_byte(HEADER_ACTIVE_OFFSET) == HEADER_ACTIVE && read_path(path);
+}
+
+void print_checkpoint_tick()
+{
+    if (state == STATE_IDLE)
+    {
+        if (card.sdprinting && !card.pause && (long)(millis() - next_checkpoint_millis) >= 0)
+            state = STATE_ARMED;
+        return;
+    }
+    if (state == STATE_WAITING)
+    {
+        if (int8_t(plan_blocks_finished - blocks_target) < 0)
+            return;
+        write_index = 0;
+        state = STATE_WRITING;
+    }
+    if (state != STATE_WRITING || !eeprom_is_ready())
+        return;
+
+    //Start writing the next byte that differs, the EEPROM finishes it in the background.
+    unsigned long start = micros();
+    uint8_t* address = (uint8_t*)PRINT_CHECKPOINT_SLOT_OFFSET(next_slot);
+    while(write_index < sizeof(print_checkpoint_t))
+    {
+        uint8_t data = ((uint8_t*)&checkpoint)[write_index];
+        if (eeprom_read_byte(address + write_index) != data)
+        {
+            eeprom_write_byte(address + write_index++, data);
+            break;
+        }
+        write_index++;
+    }
+    if (write_index >= sizeof(print_checkpoint_t))
+    {
+        next_slot = (next_slot + 1) % PRINT_CHECKPOINT_SLOTS;
+        checkpoint_count++;
+        next_checkpoint_millis = millis() + PRINT_CHECKPOINT_INTERVAL * 1000L;
+        state = STATE_IDLE;
+    }
+    checkpoint_cost(start);
+}
+
+void print_checkpoint_start()
+{
+    char path[PRINT_CHECKPOINT_PATH_LENGTH];
+
+    resume_available = false;
+    resume_return = false;
+    state = STATE_OFF;
+    eeprom_write_changed(HEADER_ACTIVE_OFFSET, "", 1);
+    if (!card.getAbsFilename(path, sizeof(path)))
+        return;
+
+    //Blocking, but only once when the print starts, before any move from the file is planned.
+    uint32_t cluster = card.getFileCluster();
+    uint32_t size = card.getFileSize();
+    print_id++;
+    eeprom_write_changed(HEADER_PRINT_ID_OFFSET, &print_id, 1);
+    eeprom_write_changed((uint8_t*)HEADER_CLUSTER_OFFSET, &cluster, 4);
+    eeprom_write_changed((uint8_t*)HEADER_SIZE_OFFSET, &size, 4);
+    eeprom_write_changed(HEADER_PATH_OFFSET, path, strlen(path) + 1);
+    uint8_t checksum = path_checksum(path);
+    eeprom_write_changed(HEADER_PATH_CHECKSUM_OFFSET, &checksum, 1);
+    eeprom_write_byte(HEADER_ACTIVE_OFFSET, HEADER_ACTIVE);
+
+    next_checkpoint_millis = millis() + PRINT_CHECKPOINT_INTERVAL * 1000L;
+    state = STATE_IDLE;
+}
+
+void print_checkpoint_clear()
+{
+    state = STATE_OFF;
+    resume_available = false;
+    resume_return = false;
+    eeprom_write_changed(HEADER_ACTIVE_OFFSET, "", 1);
+}
+
+bool print_checkpoint_armed()
+{
+    return state == STATE_ARMED;
+}
+
+void print_checkpoint_mark(uint32_t file_position)
+{
+    checkpoint.file_position = file_position;
+    state = STATE_MARKED;
+}
+
+void print_checkpoint_snapshot(float feedrate)
+{
+    if (state != STATE_MARKED)
+        return;
+    unsigned long start = micros();
+    checkpoint.sequence++;
+    checkpoint.print_id = print_id;
+    for(uint8_t axis=0; axis<NUM_AXIS; axis++)
+        checkpoint.position[axis] = current_position[axis];
+    checkpoint.feedrate = feedrate;
+    for(uint8_t e=0; e<EXTRUDERS; e++)
+    {
+        checkpoint.volume_to_filament_length[e] = volume_to_filament_length[e];
+        checkpoint.extrudemultiply[e] = extrudemultiply[e];
+        checkpoint.target_temperature[e] = target_temperature[e];
+    }
+    checkpoint.target_temperature_bed = target_temperature_bed;
+    checkpoint.fan_speed = fanSpeed;
+    checkpoint.active_extruder = active_extruder;
+    checkpoint.relative_e = axis_relative_modes[E_AXIS];
+#ifdef FWRETRACT
+    checkpoint.retract_length = retract_length;
+    checkpoint.retract_feedrate = retract_feedrate;
+    checkpoint.retract_recover_length = retract_recover_length;
+    checkpoint.retracted = retracted;
+#endif
+#if defined(PIDTEMP) && defined(PID_ADD_EXTRUSION_RATE)
+    for(uint8_t e=0; e<EXTRUDERS; e++)
+        checkpoint.Kc[e] = Kc[e];
+#endif
+    checkpoint.checksum = checkpoint_checksum(&checkpoint);
+
+    //The command is resumable once the moves planned in front of it are finished.
+    CRITICAL_SECTION_START;
+    blocks_target = plan_blocks_finished + movesplanned();
+    CRITICAL_SECTION_END;
+    state = STATE_WAITING;
+    checkpoint_cost(start);
+}
+
+bool print_checkpoint_available()
+{
+    return resume_available;
+}
+
+const char* print_checkpoint_filename(char* path)
+{
+    read_path(path);
+    const char* name = strrchr(path, '/');
+    return name ? name + 1 : path;
+}
+
+bool print_checkpoint_resume()
+{
+    char buffer[PRINT_CHECKPOINT_PATH_LENGTH];
+
+    if (!resume_available || !read_path(buffer))
+        return false;
+    card.openFile(buffer, true);
+    if (!card.isFileOpen())
+        return false;
+    if (card.getFileCluster() != eeprom_read_dword(HEADER_CLUSTER_OFFSET) || card.getFileSize() != eeprom_read_dword(HEADER_SIZE_OFFSET)
+#ifdef BINARY_GCODE
+        || card.binaryFile
+#endif
+        )
+    {
+        card.closefile();
+        return false;
+    }
+
+    active_extruder = checkpoint.active_extruder;
+    axis_relative_modes[E_AXIS] = checkpoint.relative_e;
+#ifdef FWRETRACT
+    retract_length = checkpoint.retract_length;
+    retract_feedrate = checkpoint.retract_feedrate;
+    retract_recover_length = checkpoint.retract_recover_length;
+    retracted = checkpoint.retracted;
+#endif
+    for(uint8_t e=0; e<EXTRUDERS; e++)
+    {
+        volume_to_filament_length[e] = checkpoint.volume_to_filament_length[e];
+        extrudemultiply[e] = checkpoint.extrudemultiply[e];
+#if defined(PIDTEMP) && defined(PID_ADD_EXTRUSION_RATE)
+        Kc[e] = checkpoint.Kc[e];
+#endif
+        setTargetHotend(checkpoint.target_temperature[e], e);
+    }
+    setTargetBed(checkpoint.target_temperature_bed);
+
+    //Lower the bed before homing X and Y, so the head does not run into the print.
+    enquecommand_P(PSTR("G28 Z0"));
+    enquecommand_P(PSTR("G28 X0 Y0"));
+#if TEMP_SENSOR_BED != 0
+    sprintf_P(buffer, PSTR("M190 S%i"), checkpoint.target_temperature_bed);
+    enquecommand(buffer);
+#endif
+    for(uint8_t e=0; e<EXTRUDERS; e++)
+    {
+        if (checkpoint.target_temperature[e] < 1)
+            continue;
+        sprintf_P(buffer, PSTR("M109 T%i S%i"), e, checkpoint.target_temperature[e]);
+        enquecommand(buffer);
+    }
+    enquecommand_P(PSTR("M413 R"));
+
+    //The file is read behind the commands above, starting at the checkpointed command.
+    card.setIndex(checkpoint.file_position);
+    card.startFileprint();
+    resume_available = false;
+    resume_return = true;
+    next_checkpoint_millis = millis() + PRINT_CHECKPOINT_INTERVAL * 1000L;
+    state = STATE_IDLE;
+    return true;
+}
+
+float print_checkpoint_return(float feedrate)
+{
+    if (!resume_return)
+        return feedrate;
+    resume_return = false;
+
+    //Prime at the home position like at the start of a print, then move above the checkpoint and lower onto it.
+    plan_set_e_position(-PRIMING_MM3);
+    current_position[E_AXIS] = 0;
+    plan_buffer_line(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS], PRIMING_MM3_PER_SEC * volume_to_filament_length[active_extruder], active_extruder);
+#ifdef FWRETRACT
+    //The file continues after a G10, retract the primed filament so its G11 does not push out too much.
+    if (retracted)
+    {
+        current_position[E_AXIS] = -retract_recover_length;
+        plan_buffer_line(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS], retract_feedrate / 60, active_extruder);
+    }
+#endif
+    current_position[X_AXIS] = checkpoint.position[X_AXIS];
+    current_position[Y_AXIS] = checkpoint.position[Y_AXIS];
+    plan_buffer_line(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS], homing_feedrate[X_AXIS] / 60, active_extruder);
+    current_position[Z_AXIS] = checkpoint.position[Z_AXIS];
+    plan_buffer_line(current_position[X_AXIS], current_position[Y_AXIS], current_position[Z_AXIS], current_position[E_AXIS], homing_feedrate[Z_AXIS] / 60, active_extruder);
+    current_position[E_AXIS] = checkpoint.position[E_AXIS];
+    plan_set_e_position(current_position[E_AXIS]);
+    fanSpeed = checkpoint.fan_speed;
+    return checkpoint.feedrate;
+}
+
+void print_checkpoint_report()
+{
+    SERIAL_ECHO_START;
+    if (resume_available)
+    {
+        char path[PRINT_CHECKPOINT_PATH_LENGTH];
+        print_checkpoint_filename(path);
+        SERIAL_ECHOPGM("Checkpoint: ");
+        SERIAL_ECHO(path);
+        SERIAL_ECHOPAIR(" at ", (unsigned long)checkpoint.file_position);
+        SERIAL_ECHOPAIR(" X", checkpoint.position[X_AXIS]);
+        SERIAL_ECHOPAIR(" Y", checkpoint.position[Y_AXIS]);
+        SERIAL_ECHOPAIR(" Z", checkpoint.position[Z_AXIS]);
+        SERIAL_ECHOPAIR(" E", checkpoint.position[E_AXIS]);
+        SERIAL_ECHOLNPGM("");
+    }else{
+        SERIAL_ECHOLNPGM("No checkpoint to resume");
+    }
+    SERIAL_ECHO_START;
+    SERIAL_ECHOPAIR("Checkpoints written:", (unsigned long)checkpoint_count);
+    SERIAL_ECHOPAIR(" time:", checkpoint_micros);
+    SERIAL_ECHOPAIR("us longest:", (unsigned long)checkpoint_max_micros);
+    SERIAL_ECHOLNPGM("us");
+}
+
+#endif//PRINT_CHECKPOINT
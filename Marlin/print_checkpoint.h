@@ -0,0 +1,68 @@
+#ifndef PRINT_CHECKPOINT_H
+#define PRINT_CHECKPOINT_H
+
+#include "Marlin.h"
+
+#ifdef PRINT_CHECKPOINT
+
+//Longest absolute path of a print file that can be resumed, terminator included.
+#define PRINT_CHECKPOINT_PATH_LENGTH 48
+
+//Resume point of an SD print: the first command in the file that was not finished, and the state in front of it.
+typedef struct {
+    uint16_t sequence;                          //Increases with every checkpoint written, the highest one is the newest
+    uint8_t print_id;                           //Print the checkpoint belongs to, see the header in print_checkpoint.cpp
+    uint32_t file_position;
+    float position[NUM_AXIS];                   //current_position in front of the command
+    float feedrate;
+    float volume_to_filament_length[EXTRUDERS];
+    int16_t extrudemultiply[EXTRUDERS];
+    int16_t target_temperature[EXTRUDERS];
+    int16_t target_temperature_bed;
+    uint8_t fan_speed;
+    uint8_t active_extruder;
+    uint8_t relative_e;
+#ifdef FWRETRACT
+    float retract_length;                       //M207 and M208 can change these from the print file
+    float retract_feedrate;
+    float retract_recover_length;
+    uint8_t retracted;                          //A G10 in front of the command was not recovered yet
+#endif
+#if defined(PIDTEMP) && defined(PID_ADD_EXTRUSION_RATE)
+    float Kc[EXTRUDERS];
+#endif
+    uint8_t checksum;
+} print_checkpoint_t;
+
+void print_checkpoint_init();
+void print_checkpoint_tick();
+
+//A print starts from the beginning of the file, record which file it is.
+void print_checkpoint_start();
+//The print ended or was aborted, it can no longer be resumed.
+void print_checkpoint_clear();
+
+//True when the next command read from the print file should be marked with print_checkpoint_mark().
+bool print_checkpoint_armed();
+void print_checkpoint_mark(uint32_t file_position);
+//Called when the marked command is about to be processed, with the feedrate in front of it.
+void print_checkpoint_snapshot(float feedrate);
+
+//True when a checkpoint of an unfinished print was found at startup.
+bool print_checkpoint_available();
+//Absolute path of the file of the available checkpoint, empty when the stored path is damaged. Returns the file name
+//part of path.
+const char* print_checkpoint_filename(char* path);
+//Open the file of the available checkpoint and queue the commands to continue printing it. False when the file
+//can not be opened or is not the file that was printed.
+bool print_checkpoint_resume();
+//M413 R, queued by print_checkpoint_resume() behind homing and heating: prime and move back to the checkpoint.
+//Returns the feedrate to continue with, feedrate itself when no resume is running.
+float print_checkpoint_return(float feedrate);
+
+//M413: report the available checkpoint and the time spent writing checkpoints.
+void print_checkpoint_report();
+
+#endif//PRINT_CHECKPOINT
+
+#endif//PRINT_CHECKPOINT_H
@@ -35,6 +35,15 @@
 #include <SPI.h>
 #endif
 
+#ifdef DYNAMIC_MICROSTEPPING
+  #if !defined(X_MS1_PIN) || X_MS1_PIN < 0
+    #error DYNAMIC_MICROSTEPPING requires the stepper driver microstep pins to be connected to the MCU
+  #endif
+  #ifdef COREXY
+    #error DYNAMIC_MICROSTEPPING is not supported with COREXY
+  #endif
+#endif
+
 
 //===========================================================================
 //=============================public variables  ============================
@@ -90,6 +99,25 @@ static bool check_endstops = true;
 volatile long count_position[NUM_AXIS] = { 0, 0, 0, 0};
 volatile signed char count_direction[NUM_AXIS] = { 1, 1, 1, 1};
 
+#ifdef DYNAMIC_MICROSTEPPING
+  static unsigned char microstep_axes_active = 0;     // X/Y axis bits whose drivers are in coarse microstep mode
+  static signed char microstep_scale[2] = { 1, 1 };   // Microsteps moved per step pulse on X/Y
+  static unsigned char microstep_modes_xy[2];         // X/Y mode set with microstep_mode(), what a fine block runs in
+  // Driver translator phase minus count_position on X/Y. The drivers start at their home phase on power up, where
+  // count_position is 0, G92 and homing move count_position without stepping.
+  unsigned char microstep_phase_offset[2] = { 0, 0 };
+  // X/Y axes whose translator phase follows count_position, lost when M350/M351 change the mode under it.
+  static unsigned char microstep_phase_known = (1<<X_AXIS) | (1<<Y_AXIS);
+  #define X_COUNT_STEP microstep_scale[X_AXIS]
+  #define Y_COUNT_STEP microstep_scale[Y_AXIS]
+#else
+  #define X_COUNT_STEP 1
+  #define Y_COUNT_STEP 1
+#endif
+
+static void microstep_pins(uint8_t driver, int8_t ms1, int8_t ms2);
+static void microstep_pins(uint8_t driver, uint8_t stepping_mode);
+
 //===========================================================================
 //=============================functions         ============================
 //===========================================================================
@@ -314,6 +342,23 @@ FORCE_INLINE void trapezoid_generator_reset() {
   acceleration_time = calc_timer(acc_step_rate);
   OCR1A = acceleration_time;
 
+  #ifdef DYNAMIC_MICROSTEPPING
+    // Block boundary, both coarse and fine blocks start on a coarse step so the drivers can switch mode here.
+    if (current_block->microstep_axes != microstep_axes_active) {
+      for(int8_t i=X_AXIS; i <= Y_AXIS; i++) {
+        if (current_block->microstep_axes & (1<<i)) {
+          microstep_pins(i, microstep_modes_xy[i] >> DYNAMIC_MICROSTEP_SHIFT);
+          microstep_scale[i] = (1 << DYNAMIC_MICROSTEP_SHIFT);
+        }
+        else {
+          microstep_pins(i, microstep_modes_xy[i]);
+          microstep_scale[i] = 1;
+        }
+      }
+      microstep_axes_active = current_block->microstep_axes;
+    }
+  #endif
+
 //    SERIAL_ECHO_START;
 //    SERIAL_ECHOPGM("advance :");
 //    SERIAL_ECHO(current_block->advance/256.0);
@@ -368,19 +413,19 @@ ISR(TIMER1_COMPA_vect)
     // Set the direction bits (X_AXIS=A_AXIS and Y_AXIS=B_AXIS for COREXY)
     if((out_bits & (1<<X_AXIS))!=0){
       WRITE(X_DIR_PIN, INVERT_X_DIR);
-      count_direction[X_AXIS]=-1;
+      count_direction[X_AXIS]=-X_COUNT_STEP;
     }
     else{
       WRITE(X_DIR_PIN, !INVERT_X_DIR);
-      count_direction[X_AXIS]=1;
+      count_direction[X_AXIS]=X_COUNT_STEP;
     }
     if((out_bits & (1<<Y_AXIS))!=0){
       WRITE(Y_DIR_PIN, INVERT_Y_DIR);
-      count_direction[Y_AXIS]=-1;
+      count_direction[Y_AXIS]=-Y_COUNT_STEP;
     }
     else{
       WRITE(Y_DIR_PIN, !INVERT_Y_DIR);
-      count_direction[Y_AXIS]=1;
+      count_direction[Y_AXIS]=Y_COUNT_STEP;
     }
 
     // Set direction en check limit switches
@@ -888,6 +933,10 @@ void st_synchronize()
 void st_set_position(const long &x, const long &y, const long &z, const long &e)
 {
   CRITICAL_SECTION_START;
+#ifdef DYNAMIC_MICROSTEPPING
+  microstep_phase_offset[X_AXIS] += count_position[X_AXIS] - x;
+  microstep_phase_offset[Y_AXIS] += count_position[Y_AXIS] - y;
+#endif
   count_position[X_AXIS] = x;
   count_position[Y_AXIS] = y;
   count_position[Z_AXIS] = z;
@@ -992,6 +1041,15 @@ void microstep_init()
 }
 
 void microstep_ms(uint8_t driver, int8_t ms1, int8_t ms2)
+{
+#ifdef DYNAMIC_MICROSTEPPING
+  if (driver <= Y_AXIS)
+    microstep_phase_known &= ~(1<<driver);
+#endif
+  microstep_pins(driver, ms1, ms2);
+}
+
+static void microstep_pins(uint8_t driver, int8_t ms1, int8_t ms2)
 {
   if(ms1 > -1) switch(driver)
   {
@@ -1011,18 +1069,47 @@ void microstep_ms(uint8_t driver, int8_t ms1, int8_t ms2)
   }
 }
 
-void microstep_mode(uint8_t driver, uint8_t stepping_mode)
+static void microstep_pins(uint8_t driver, uint8_t stepping_mode)
 {
   switch(stepping_mode)
   {
-    case 1: microstep_ms(driver,MICROSTEP1); break;
-    case 2: microstep_ms(driver,MICROSTEP2); break;
-    case 4: microstep_ms(driver,MICROSTEP4); break;
-    case 8: microstep_ms(driver,MICROSTEP8); break;
-    case 16: microstep_ms(driver,MICROSTEP16); break;
+    case 1: microstep_pins(driver,MICROSTEP1); break;
+    case 2: microstep_pins(driver,MICROSTEP2); break;
+    case 4: microstep_pins(driver,MICROSTEP4); break;
+    case 8: microstep_pins(driver,MICROSTEP8); break;
+    case 16: microstep_pins(driver,MICROSTEP16); break;
+  }
+}
+
+void microstep_mode(uint8_t driver, uint8_t stepping_mode)
+{
+#ifdef DYNAMIC_MICROSTEPPING
+  if (driver <= Y_AXIS)
+  {
+    // Called with the steppers idle (microstep_init, M350), a driver still in coarse mode from the last block
+    // is switched to the new mode right away. A new mode moves count_position to other units than the
+    // translator phase, unless it is the mode the phase was tracked in.
+    if (microstep_modes_xy[driver] != 0 && microstep_modes_xy[driver] != stepping_mode)
+      microstep_phase_known &= ~(1<<driver);
+    microstep_modes_xy[driver] = stepping_mode;
+    microstep_axes_active &= ~(1<<driver);
+    microstep_scale[driver] = 1;
   }
+#endif
+  microstep_pins(driver, stepping_mode);
 }
 
+#ifdef DYNAMIC_MICROSTEPPING
+unsigned char microstep_coarse_axes()
+{
+  unsigned char axes = microstep_phase_known;
+  for(int8_t i=X_AXIS; i <= Y_AXIS; i++)
+    if (microstep_modes_xy[i] < (1 << DYNAMIC_MICROSTEP_SHIFT))
+      axes &= ~(1<<i);
+  return axes;
+}
+#endif
+
 void microstep_readings()
 {
       SERIAL_PROTOCOLPGM("MS1,MS2 Pins\n");
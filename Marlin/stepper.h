@@ -85,4 +85,11 @@ void digipot_current(uint8_t driver, int current);
 void microstep_init();
 void microstep_readings();
 
+#ifdef DYNAMIC_MICROSTEPPING
+// X/Y axes that can run coarse travel blocks: in a mode that can be divided and with a known translator phase.
+unsigned char microstep_coarse_axes();
+// Translator phase minus count_position on X/Y, the coarse step grid is aligned to the phase, not to count_position.
+extern unsigned char microstep_phase_offset[2];
+#endif
+
 #endif
@@ -29,6 +29,7 @@
  */
 
 
+#include <avr/eeprom.h>
 #include "Marlin.h"
 #include "ultralcd.h"
 #include "lifetime_stats.h"
@@ -36,6 +37,9 @@
 #include "temperature.h"
 #include "watchdog.h"
 #include "Sd2Card.h"
+#ifdef TEMP_TABLES_DIRECT_INDEX
+#include "thermistortables_indexed.h"
+#endif
 
 
 //===========================================================================
@@ -56,7 +60,7 @@ float current_temperature_bed = 0.0;
   float Ki=(DEFAULT_Ki*PID_dT);
   float Kd=(DEFAULT_Kd/PID_dT);
   #ifdef PID_ADD_EXTRUSION_RATE
-    float Kc=DEFAULT_Kc;
+    float Kc[EXTRUDERS]=ARRAY_BY_EXTRUDERS(DEFAULT_Kc, DEFAULT_Kc, DEFAULT_Kc);
   #endif
 #endif //PIDTEMP
 
@@ -78,6 +82,23 @@ static volatile bool temp_meas_ready = false;
 
 #ifdef PIDTEMP
   //static cannot be external:
+#ifdef PID_FIXED_POINT
+  // Temperatures in 1/16 degree C, the P, I and D terms in 1/256 PWM steps.
+  #define PID_FP_TEMP_SHIFT 4
+  #define PID_FP_TERM_SHIFT 8
+  #define PID_FP_KI_SHIFT 16
+  #define PID_FP_K2_SHIFT 12
+  #define PID_FP_K2 ((long)((1.0-K1) * (1L << PID_FP_K2_SHIFT) + 0.5))
+  static long Kp_fp, Ki_fp, Kd_fp;  // Kp in 1/256, Ki in 1/65536 and Kd in 1/16 units
+  static long temp_iState[EXTRUDERS] = { 0 };
+  static int temp_dState[EXTRUDERS] = { 0 };
+  static long pTerm[EXTRUDERS];
+  static long iTerm[EXTRUDERS];
+  static long dTerm[EXTRUDERS];
+  static int pid_error[EXTRUDERS];
+  static long temp_iState_min[EXTRUDERS];
+  static long temp_iState_max[EXTRUDERS];
+#else
   static float temp_iState[EXTRUDERS] = { 0 };
   static float temp_dState[EXTRUDERS] = { 0 };
   static float pTerm[EXTRUDERS];
@@ -87,6 +108,7 @@ static volatile bool temp_meas_ready = false;
   static float pid_error[EXTRUDERS];
   static float temp_iState_min[EXTRUDERS];
   static float temp_iState_max[EXTRUDERS];
+#endif
   // static float pid_input[EXTRUDERS];
   // static float pid_output[EXTRUDERS];
   static bool pid_reset[EXTRUDERS];
@@ -107,6 +129,25 @@ static volatile bool temp_meas_ready = false;
 #endif //PIDTEMPBED
   static unsigned char soft_pwm[EXTRUDERS];
   static unsigned char soft_pwm_bed;
+  static void manage_heater_bed();
+  static void soft_pwm_cancel_heaters();
+#ifdef HEATER_POWER_BUDGET
+  // Longest on-time the power budget allows and the pwm_count it starts at, the ISR uses the lower of soft_pwm and the limit.
+  static unsigned char soft_pwm_limit[EXTRUDERS];
+  static unsigned char soft_pwm_phase[EXTRUDERS];
+  static unsigned char soft_pwm_limit_bed;
+  static unsigned char soft_pwm_phase_bed;
+  static void power_budget_apply();
+  #define SOFT_PWM_APPLIED(e) min(soft_pwm[e], soft_pwm_limit[e])
+  #define SOFT_PWM_PHASE(e) soft_pwm_phase[e]
+  #define SOFT_PWM_APPLIED_BED min(soft_pwm_bed, soft_pwm_limit_bed)
+  #define SOFT_PWM_PHASE_BED soft_pwm_phase_bed
+#else
+  #define SOFT_PWM_APPLIED(e) soft_pwm[e]
+  #define SOFT_PWM_PHASE(e) 0
+  #define SOFT_PWM_APPLIED_BED soft_pwm_bed
+  #define SOFT_PWM_PHASE_BED 0
+#endif
 #ifdef FAN_SOFT_PWM
   static unsigned char soft_pwm_fan;
 #endif
@@ -132,6 +173,34 @@ static int bed_maxttemp_raw = HEATER_BED_RAW_HI_TEMP;
 
 static unsigned long max_heating_start_millis[EXTRUDERS];
 static float max_heating_start_temperature[EXTRUDERS];
+#ifdef HEATUP_SYNCHRONIZE
+//Heating rate in degC per second at full power without losses and the fraction of the temperature above HEATUP_AMBIENT
+// lost per second, the bed is heater HEATUP_BED. A loss of 0 is not learned yet.
+static float heatup_rate[EXTRUDERS + 1];
+static float heatup_loss[EXTRUDERS + 1];
+static unsigned long heatup_rate_start_millis[EXTRUDERS + 1];
+static float heatup_rate_start_temperature[EXTRUDERS + 1];
+static bool heatup_rate_full_power[EXTRUDERS + 1];
+static void heatup_rate_learn(uint8_t heater, int power, int max_power, float temperature);
+static void heatup_rate_load(uint8_t heater);
+static void heatup_rate_save(uint8_t heater);
+static void heatup_rate_write();
+static uint8_t heatup_rate_save_pending;//Heaters whose learned rates may have to be written to EEPROM
+static uint8_t heatup_rate_write_heater = 0xFF;//Heater being written, 0xFF when none
+static uint8_t heatup_rate_write_index;//Next byte of heatup_rate_write_data to write
+static float heatup_rate_write_data[2];//Rate and loss being written, taken when the write starts so they can not change halfway
+#if TEMP_SENSOR_BED != 0
+static unsigned long heatup_bed_delay_millis;//Time the bed heater may start, 0 when it is not held back.
+#endif
+#endif
+#ifdef HEATER_MODEL_CHECK
+static unsigned long heater_model_start_millis[EXTRUDERS];
+static unsigned long heater_model_last_millis[EXTRUDERS];
+static float heater_model_start_temperature[EXTRUDERS];
+static float heater_model_expected[EXTRUDERS];
+static int8_t heater_model_faults[EXTRUDERS];//Consecutive failed windows, negative when too cold, positive when too hot.
+static void heater_model_check(uint8_t e);
+#endif
 
 #ifdef TEMP_SENSOR_1_AS_REDUNDANT
   static void *heater_ttbl_map[2] = {(void *)HEATER_0_TEMPTABLE, (void *)HEATER_1_TEMPTABLE };
@@ -140,6 +209,13 @@ static float max_heating_start_temperature[EXTRUDERS];
   static void *heater_ttbl_map[EXTRUDERS] = ARRAY_BY_EXTRUDERS( (void *)HEATER_0_TEMPTABLE, (void *)HEATER_1_TEMPTABLE, (void *)HEATER_2_TEMPTABLE );
   static uint8_t heater_ttbllen_map[EXTRUDERS] = ARRAY_BY_EXTRUDERS( HEATER_0_TEMPTABLE_LEN, HEATER_1_TEMPTABLE_LEN, HEATER_2_TEMPTABLE_LEN );
 #endif
+#ifdef TEMP_TABLES_DIRECT_INDEX
+#ifdef TEMP_SENSOR_1_AS_REDUNDANT
+  static const short *heater_ttbl_indexed_map[2] = { (const short *)HEATER_0_TEMPTABLE_INDEXED, (const short *)HEATER_1_TEMPTABLE_INDEXED };
+#else
+  static const short *heater_ttbl_indexed_map[EXTRUDERS] = ARRAY_BY_EXTRUDERS( (const short *)HEATER_0_TEMPTABLE_INDEXED, (const short *)HEATER_1_TEMPTABLE_INDEXED, (const short *)HEATER_2_TEMPTABLE_INDEXED );
+#endif
+#endif
 
 static float analog2temp(int raw, uint8_t e);
 static float analog2tempBed(int raw);
@@ -175,10 +251,12 @@ void PID_autotune(float temp, int extruder, int ncycles)
 
   long bias, d;
   float Ku, Tu;
-  float Kp, Ki, Kd;
+  float Ku_last = 0, Tu_last = 0;
+  float tune_Kp = 0, tune_Ki = 0, tune_Kd = 0;
+  bool converged = false;
   float max = 0, min = 10000;
 
-  if ((extruder > EXTRUDERS)
+  if ((extruder >= EXTRUDERS)
   #if (TEMP_BED_PIN <= -1)
        ||(extruder < 0)
   #endif
@@ -246,13 +324,13 @@ void PID_autotune(float temp, int extruder, int ncycles)
               Tu = ((float)(t_low + t_high)/1000.0);
               SERIAL_PROTOCOLPGM(" Ku: "); SERIAL_PROTOCOL(Ku);
               SERIAL_PROTOCOLPGM(" Tu: "); SERIAL_PROTOCOLLN(Tu);
-              Kp = 0.6*Ku;
-              Ki = 2*Kp/Tu;
-              Kd = Kp*Tu/8;
+              tune_Kp = 0.6*Ku;
+              tune_Ki = 2*tune_Kp/Tu;
+              tune_Kd = tune_Kp*Tu/8;
               SERIAL_PROTOCOLLNPGM(" Clasic PID ");
-              SERIAL_PROTOCOLPGM(" Kp: "); SERIAL_PROTOCOLLN(Kp);
-              SERIAL_PROTOCOLPGM(" Ki: "); SERIAL_PROTOCOLLN(Ki);
-              SERIAL_PROTOCOLPGM(" Kd: "); SERIAL_PROTOCOLLN(Kd);
+              SERIAL_PROTOCOLPGM(" Kp: "); SERIAL_PROTOCOLLN(tune_Kp);
+              SERIAL_PROTOCOLPGM(" Ki: "); SERIAL_PROTOCOLLN(tune_Ki);
+              SERIAL_PROTOCOLPGM(" Kd: "); SERIAL_PROTOCOLLN(tune_Kd);
               /*
               Kp = 0.33*Ku;
               Ki = Kp/Tu;
@@ -269,6 +347,12 @@ void PID_autotune(float temp, int extruder, int ncycles)
               SERIAL_PROTOCOLPGM(" Ki: "); SERIAL_PROTOCOLLN(Ki);
               SERIAL_PROTOCOLPGM(" Kd: "); SERIAL_PROTOCOLLN(Kd);
               */
+
+              //Once the amplitude and the period of two cycles in a row agree the next cycles will not tell us anything new.
+              if(Ku_last > 0 && fabs(Ku - Ku_last) < Ku * PID_AUTOTUNE_TOLERANCE && fabs(Tu - Tu_last) < Tu * PID_AUTOTUNE_TOLERANCE)
+                converged = true;
+              Ku_last = Ku;
+              Tu_last = Tu;
             }
           }
           if (extruder<0)
@@ -279,9 +363,13 @@ void PID_autotune(float temp, int extruder, int ncycles)
           min=temp;
         }
       }
+      #ifdef HEATER_POWER_BUDGET
+      power_budget_apply();
+      #endif
     }
     if(input > (temp + 20)) {
       SERIAL_PROTOCOLLNPGM("PID Autotune failed! Temperature too high");
+      disable_heater();
       return;
     }
     if(millis() - temp_millis > 2000) {
@@ -302,10 +390,39 @@ void PID_autotune(float temp, int extruder, int ncycles)
     }
     if(((millis() - t1) + (millis() - t2)) > (10L*60L*1000L*2L)) {
       SERIAL_PROTOCOLLNPGM("PID Autotune failed! timeout");
+      disable_heater();
       return;
     }
-    if(cycles > ncycles) {
-      SERIAL_PROTOCOLLNPGM("PID Autotune finished! Put the Kp, Ki and Kd constants into Configuration.h");
+    if(converged || cycles > ncycles) {
+      disable_heater();
+      if(!converged) {
+        SERIAL_PROTOCOLLNPGM("PID Autotune failed! Ku and Tu did not settle, try more cycles (C)");
+        return;
+      }
+      SERIAL_PROTOCOLPGM(" Kp: "); SERIAL_PROTOCOL(tune_Kp);
+      SERIAL_PROTOCOLPGM(" Ki: "); SERIAL_PROTOCOL(tune_Ki);
+      SERIAL_PROTOCOLPGM(" Kd: "); SERIAL_PROTOCOLLN(tune_Kd);
+      if(extruder<0) {
+#ifdef PIDTEMPBED
+        bedKp = tune_Kp;
+        bedKi = scalePID_i(tune_Ki);
+        bedKd = scalePID_d(tune_Kd);
+        updatePID();
+        SERIAL_PROTOCOLLNPGM("PID Autotune finished! The bed PID constants are active, M500 stores them");
+#else
+        SERIAL_PROTOCOLLNPGM("PID Autotune finished! Enable PIDTEMPBED and put the Kp, Ki and Kd constants into Configuration.h");
+#endif
+      }else{
+#ifdef PIDTEMP
+        Kp = tune_Kp;
+        Ki = scalePID_i(tune_Ki);
+        Kd = scalePID_d(tune_Kd);
+        updatePID();
+        SERIAL_PROTOCOLLNPGM("PID Autotune finished! The PID constants are active, M500 stores them");
+#else
+        SERIAL_PROTOCOLLNPGM("PID Autotune finished! Put the Kp, Ki and Kd constants into Configuration.h");
+#endif
+      }
       return;
     }
     lcd_update();
@@ -316,8 +433,18 @@ void PID_autotune(float temp, int extruder, int ncycles)
 void updatePID()
 {
 #ifdef PIDTEMP
+  #ifdef PID_FIXED_POINT
+  // Kp above ~500 already gives full power for half a degree of error, limit it so Kp * error fits in 32 bit.
+  Kp_fp = min(Kp * (1L << PID_FP_TERM_SHIFT), 0x7FFFFFFFL / (PID_FUNCTIONAL_RANGE << PID_FP_TEMP_SHIFT));
+  Ki_fp = Ki * (1L << PID_FP_KI_SHIFT);
+  Kd_fp = Kd * (1L << (PID_FP_TERM_SHIFT - PID_FP_TEMP_SHIFT));
+  #endif
   for(int e = 0; e < EXTRUDERS; e++) {
+  #ifdef PID_FIXED_POINT
+     temp_iState_max[e] = PID_INTEGRAL_DRIVE_MAX / Ki * (1 << PID_FP_TEMP_SHIFT);
+  #else
      temp_iState_max[e] = PID_INTEGRAL_DRIVE_MAX / Ki;
+  #endif
   }
 #endif
 #ifdef PIDTEMPBED
@@ -403,11 +530,134 @@ void checkExtruderAutoFans()
 
 #endif // any extruder auto fan pins set
 
+#ifdef TEMP_HISTORY
+static tempHistorySample temp_history[TEMP_HISTORY_SIZE];
+static uint8_t temp_history_head;  // Where the next sample goes
+static uint8_t temp_history_used;
+static uint8_t temp_history_divider;
+bool temp_history_stream = false;
+
+uint8_t temp_history_count()
+{
+  return temp_history_used;
+}
+
+const tempHistorySample* temp_history_get(uint8_t index)
+{
+  uint8_t n = temp_history_head + TEMP_HISTORY_SIZE - temp_history_used + index;
+  if (n >= TEMP_HISTORY_SIZE)
+    n -= TEMP_HISTORY_SIZE;
+  return &temp_history[n];
+}
+
+// One CSV line. The time is printed as millis() of the sample, rebuilt from the 16 bit time which is fine for the last 10 minutes.
+static void temp_history_print(const tempHistorySample* sample)
+{
+  unsigned long now = millis();
+  SERIAL_PROTOCOL(now - 10UL * (uint16_t)(uint16_t(now / 10) - sample->time));
+  for(uint8_t h=0; h<TEMP_HISTORY_HEATERS; h++)
+  {
+    SERIAL_PROTOCOLPGM(",");
+    SERIAL_PROTOCOL_F(float(sample->temperature[h]) / TEMP_HISTORY_TEMP_SCALE, 2);
+    SERIAL_PROTOCOLPGM(",");
+    SERIAL_PROTOCOL(sample->target[h]);
+    SERIAL_PROTOCOLPGM(",");
+    SERIAL_PROTOCOL(int(sample->pwm[h]));
+  }
+  SERIAL_PROTOCOLLN("");
+}
+
+static void temp_history_print_header()
+{
+  SERIAL_PROTOCOLPGM("time");
+  for(uint8_t h=0; h<TEMP_HISTORY_HEATERS; h++)
+  {
+    if (h < EXTRUDERS)
+    {
+      SERIAL_PROTOCOLPGM(",T");
+      SERIAL_PROTOCOL(int(h));
+      SERIAL_PROTOCOLPGM(",T");
+      SERIAL_PROTOCOL(int(h));
+      SERIAL_PROTOCOLPGM("target,T");
+      SERIAL_PROTOCOL(int(h));
+      SERIAL_PROTOCOLPGM("pwm");
+    }else{
+      SERIAL_PROTOCOLPGM(",B,Btarget,Bpwm");
+    }
+  }
+  SERIAL_PROTOCOLLN("");
+}
+
+void temp_history_dump()
+{
+  temp_history_print_header();
+  for(uint8_t n=0; n<temp_history_used; n++)
+    temp_history_print(temp_history_get(n));
+}
+
+static void temp_history_record()
+{
+  if (++temp_history_divider < TEMP_HISTORY_INTERVAL)
+    return;
+  temp_history_divider = 0;
+
+  tempHistorySample* sample = &temp_history[temp_history_head];
+  sample->time = millis() / 10;
+  for(uint8_t e=0; e<EXTRUDERS; e++)
+  {
+    sample->temperature[e] = current_temperature[e] * TEMP_HISTORY_TEMP_SCALE;
+    sample->target[e] = target_temperature[e];
+    sample->pwm[e] = soft_pwm[e];
+  }
+#if TEMP_SENSOR_BED != 0
+  sample->temperature[EXTRUDERS] = current_temperature_bed * TEMP_HISTORY_TEMP_SCALE;
+  sample->target[EXTRUDERS] = target_temperature_bed;
+  sample->pwm[EXTRUDERS] = soft_pwm_bed;
+#endif
+  if (++temp_history_head >= TEMP_HISTORY_SIZE)
+    temp_history_head = 0;
+  if (temp_history_used < TEMP_HISTORY_SIZE)
+    temp_history_used++;
+
+  if (temp_history_stream)
+    temp_history_print(sample);
+}
+#endif//TEMP_HISTORY
+
+#if defined(PIDTEMP) && defined(PID_ADD_EXTRUSION_RATE)
+// Filament speed in mm/s of the printing move the stepper is executing with extruder e, 0 when it is not extruding.
+// Travel moves and retractions do not melt plastic, so those give 0 as well.
+static float extrusion_rate(uint8_t e)
+{
+  long steps_e = 0;
+  float nominal_speed = 0.0;
+  float millimeters = 0.0;
+
+  CRITICAL_SECTION_START;
+  block_t *block = current_block;
+  if (block != NULL && block->active_extruder == e && (block->steps_x != 0 || block->steps_y != 0) && !(block->direction_bits & (1<<E_AXIS)))
+  {
+    steps_e = block->steps_e;
+    nominal_speed = block->nominal_speed;
+    millimeters = block->millimeters;
+  }
+  CRITICAL_SECTION_END;
+
+  if (steps_e == 0 || millimeters <= 0.0)
+    return 0.0;
+  return float(steps_e) / axis_steps_per_unit[E_AXIS] * nominal_speed / millimeters;
+}
+#endif
+
 void manage_heater()
 {
   float pid_input;
   float pid_output;
 
+#ifdef HEATUP_SYNCHRONIZE
+  heatup_rate_write();
+#endif
+
   if(temp_meas_ready != true)   //better readability
     return;
 
@@ -429,7 +679,36 @@ void manage_heater()
   #ifdef PIDTEMP
     pid_input = current_temperature[e];
 
-    #ifndef PID_OPENLOOP
+    #if !defined(PID_OPENLOOP) && defined(PID_FIXED_POINT)
+        int pid_input_fp = pid_input * (1 << PID_FP_TEMP_SHIFT);
+        pid_error[e] = (target_temperature[e] << PID_FP_TEMP_SHIFT) - pid_input_fp;
+        if(pid_error[e] > (PID_FUNCTIONAL_RANGE << PID_FP_TEMP_SHIFT)) {
+          pid_output = BANG_MAX;
+          pid_reset[e] = true;
+        }
+        else if(pid_error[e] < -(PID_FUNCTIONAL_RANGE << PID_FP_TEMP_SHIFT) || target_temperature[e] == 0) {
+          pid_output = 0;
+          pid_reset[e] = true;
+        }
+        else {
+          if(pid_reset[e] == true) {
+            temp_iState[e] = 0;
+            pid_reset[e] = false;
+          }
+          pTerm[e] = (Kp_fp * pid_error[e]) >> PID_FP_TEMP_SHIFT;
+          temp_iState[e] += pid_error[e];
+          temp_iState[e] = constrain(temp_iState[e], temp_iState_min[e], temp_iState_max[e]);
+          iTerm[e] = (Ki_fp * temp_iState[e]) >> (PID_FP_KI_SHIFT + PID_FP_TEMP_SHIFT - PID_FP_TERM_SHIFT);
+
+          // Same low pass as the float version: dTerm = dTerm*K1 + dInput*Kd*(1-K1), written as dTerm += (dInput*Kd - dTerm)*(1-K1).
+          // The limits only keep the products in 32 bit, a 16 degree C step per sample is far beyond any real heater.
+          long d_input = constrain(pid_input_fp - temp_dState[e], -255, 255);
+          long d_error = constrain(Kd_fp * d_input - dTerm[e], -(1L << (31 - PID_FP_K2_SHIFT)) + 1, (1L << (31 - PID_FP_K2_SHIFT)) - 1);
+          dTerm[e] += (d_error * PID_FP_K2) >> PID_FP_K2_SHIFT;
+          pid_output = constrain((pTerm[e] + iTerm[e] - dTerm[e]) >> PID_FP_TERM_SHIFT, 0, PID_MAX);
+        }
+        temp_dState[e] = pid_input_fp;
+    #elif !defined(PID_OPENLOOP)
         pid_error[e] = target_temperature[e] - pid_input;
         if(pid_error[e] > PID_FUNCTIONAL_RANGE) {
           pid_output = BANG_MAX;
@@ -458,7 +737,17 @@ void manage_heater()
     #else
           pid_output = constrain(target_temperature[e], 0, PID_MAX);
     #endif //PID_OPENLOOP
+    #ifdef PID_ADD_EXTRUSION_RATE
+    // Feed the power that the extruded plastic takes away directly to the heater, instead of waiting for the PID to see the temperature drop.
+    if(!pid_reset[e] && Kc[e] > 0)
+      pid_output = constrain(pid_output + Kc[e] * extrusion_rate(e), 0, PID_MAX);
+    #endif
     #ifdef PID_DEBUG
+    #ifdef PID_FIXED_POINT
+      #define PID_DEBUG_TERM(x) ((float)(x) / (1L << PID_FP_TERM_SHIFT))
+    #else
+      #define PID_DEBUG_TERM(x) (x)
+    #endif
     SERIAL_ECHO_START;
     SERIAL_ECHOPGM(" PIDDEBUG ");
     SERIAL_ECHO(e);
@@ -467,11 +756,11 @@ void manage_heater()
     SERIAL_ECHOPGM(" Output ");
     SERIAL_ECHO(pid_output);
     SERIAL_ECHOPGM(" pTerm ");
-    SERIAL_ECHO(pTerm[e]);
+    SERIAL_ECHO(PID_DEBUG_TERM(pTerm[e]));
     SERIAL_ECHOPGM(" iTerm ");
-    SERIAL_ECHO(iTerm[e]);
+    SERIAL_ECHO(PID_DEBUG_TERM(iTerm[e]));
     SERIAL_ECHOPGM(" dTerm ");
-    SERIAL_ECHOLN(dTerm[e]);
+    SERIAL_ECHOLN(PID_DEBUG_TERM(dTerm[e]));
     #endif //PID_DEBUG
   #else /* PID off */
     pid_output = 0;
@@ -480,6 +769,10 @@ void manage_heater()
     }
   #endif
 
+    #ifdef HEATER_MODEL_CHECK
+    heater_model_check(e);
+    #endif
+
     // Check if temperature is within the correct range
     if((current_temperature[e] > minttemp[e]) && (current_temperature[e] < maxttemp[e]))
     {
@@ -537,6 +830,9 @@ void manage_heater()
     }else{
         max_heating_start_millis[e] = 0;
     }
+    #ifdef HEATUP_SYNCHRONIZE
+    heatup_rate_learn(e, soft_pwm[e], PID_MAX >> 1, current_temperature[e]);
+    #endif
   } // End extruder for loop
 
   #if (defined(EXTRUDER_0_AUTO_FAN_PIN) && EXTRUDER_0_AUTO_FAN_PIN > -1) || \
@@ -567,6 +863,26 @@ void manage_heater()
     }
   }
 
+  #ifdef TEMP_HISTORY
+  temp_history_record();
+  #endif
+  #if defined(HEATUP_SYNCHRONIZE) && TEMP_SENSOR_BED != 0
+  heatup_rate_learn(HEATUP_BED, soft_pwm_bed, MAX_BED_POWER >> 1, current_temperature_bed);
+  #endif
+
+  manage_heater_bed();
+
+  #ifdef HEATER_POWER_BUDGET
+  //After the bed section, so the budget is placed with the duty cycles of this measurement.
+  power_budget_apply();
+  #endif
+}
+
+static void manage_heater_bed()
+{
+  float pid_input;
+  float pid_output;
+
   #ifndef PIDTEMPBED
   if(millis() - previous_millis_bed_heater < BED_CHECK_INTERVAL)
     return;
@@ -575,6 +891,14 @@ void manage_heater()
 
   #if TEMP_SENSOR_BED != 0
 
+  #ifdef HEATUP_SYNCHRONIZE
+  if (heatupBedDelayed())
+  {
+    soft_pwm_bed = 0;
+    return;
+  }
+  #endif
+
   #ifdef PIDTEMPBED
     pid_input = current_temperature_bed;
 
@@ -645,6 +969,24 @@ void manage_heater()
 }
 
 #define PGM_RD_W(x)   (short)pgm_read_word(&x)
+#ifdef TEMP_TABLES_DIRECT_INDEX
+// The indexed tables have an entry for every ADC value, so there is nothing to search for:
+// read the entry below the raw value and interpolate the oversampling remainder in integer math.
+static float indexed2temp(const short *table, int raw)
+{
+  if (raw < 0)
+    raw = 0;
+  if (raw > (TEMPTABLE_INDEXED_LEN - 1) * OVERSAMPLENR)
+    raw = (TEMPTABLE_INDEXED_LEN - 1) * OVERSAMPLENR;
+  uint16_t n = raw / OVERSAMPLENR;
+  uint8_t fraction = raw % OVERSAMPLENR;
+  short temp = PGM_RD_W(table[n]);
+  if (fraction)
+    temp += (PGM_RD_W(table[n + 1]) - temp) * fraction / OVERSAMPLENR;
+  return temp * (1.0 / (1 << TEMPTABLE_INDEXED_FRACTION_BITS));
+}
+#endif
+
 // Derived from RepRap FiveD extruder::getTemperature()
 // For hot end temperature measurement.
 static float analog2temp(int raw, uint8_t e) {
@@ -668,6 +1010,10 @@ static float analog2temp(int raw, uint8_t e) {
 
   if(heater_ttbl_map[e] != NULL)
   {
+  #ifdef TEMP_TABLES_DIRECT_INDEX
+    if (heater_ttbl_indexed_map[e] != NULL)
+      return indexed2temp(heater_ttbl_indexed_map[e], raw);
+  #endif
     float celsius = 0;
     uint8_t i;
     short (*tt)[][2] = (short (*)[][2])(heater_ttbl_map[e]);
@@ -695,7 +1041,9 @@ static float analog2temp(int raw, uint8_t e) {
 // Derived from RepRap FiveD extruder::getTemperature()
 // For bed temperature measurement.
 static float analog2tempBed(int raw) {
-  #ifdef BED_USES_THERMISTOR
+  #if defined(BED_USES_THERMISTOR) && defined(BEDTEMPTABLE_INDEXED)
+    return indexed2temp(BEDTEMPTABLE_INDEXED, raw);
+  #elif defined(BED_USES_THERMISTOR)
     float celsius = 0;
     byte i;
 
@@ -758,15 +1106,23 @@ void tp_init()
   for(int e = 0; e < EXTRUDERS; e++) {
     // populate with the first value
     maxttemp[e] = maxttemp[0];
+#ifdef HEATUP_SYNCHRONIZE
+    heatup_rate[e] = DEFAULT_HEATUP_RATE_HOTEND;
+    heatup_rate_load(e);
+#endif
 #ifdef PIDTEMP
-    temp_iState_min[e] = 0.0;
-    temp_iState_max[e] = PID_INTEGRAL_DRIVE_MAX / Ki;
+    temp_iState_min[e] = 0;
 #endif //PIDTEMP
 #ifdef PIDTEMPBED
     temp_iState_min_bed = 0.0;
     temp_iState_max_bed = PID_INTEGRAL_DRIVE_MAX / bedKi;
 #endif //PIDTEMPBED
   }
+#ifdef HEATUP_SYNCHRONIZE
+  heatup_rate[HEATUP_BED] = DEFAULT_HEATUP_RATE_BED;
+  heatup_rate_load(HEATUP_BED);
+#endif
+  updatePID();
 
   #if defined(HEATER_0_PIN) && (HEATER_0_PIN > -1)
     SET_OUTPUT(HEATER_0_PIN);
@@ -981,6 +1337,9 @@ void disable_heater()
   #if defined(TEMP_BED_PIN) && TEMP_BED_PIN > -1
     target_temperature_bed=0;
     soft_pwm_bed=0;
+    #if defined(HEATUP_SYNCHRONIZE) && TEMP_SENSOR_BED != 0
+    heatup_bed_delay_millis = 0;
+    #endif
     #ifdef PIDTEMPBED
     pTerm_bed = 0;
     iTerm_bed = 0;
@@ -989,8 +1348,208 @@ void disable_heater()
       WRITE(HEATER_BED_PIN,LOW);
     #endif
   #endif
+  soft_pwm_cancel_heaters();
+}
+
+#ifdef HEATUP_SYNCHRONIZE
+//Learn the heating rate from every HEATUP_RATE_WINDOW the heater runs at full power and the loss from every window it is off,
+// averaged over a few windows. The heating rate adds the loss at the average temperature of the window to the measured rise.
+static void heatup_rate_learn(uint8_t heater, int power, int max_power, float temperature)
+{
+    bool full_power = (power == max_power);
+    if ((power != 0 && !full_power) || full_power != heatup_rate_full_power[heater])
+    {
+        heatup_rate_start_millis[heater] = 0;
+        heatup_rate_full_power[heater] = full_power;
+        return;
+    }
+    unsigned long now = millis();
+    if (heatup_rate_start_millis[heater] == 0)
+    {
+        heatup_rate_start_millis[heater] = now;
+        heatup_rate_start_temperature[heater] = temperature;
+        return;
+    }
+    if (now - heatup_rate_start_millis[heater] < HEATUP_RATE_WINDOW)
+        return;
+    //A loss sample needs a drop of a few ADC steps, a window of a heater that is only off for a moment would mostly measure the rounding.
+    if (!full_power && heatup_rate_start_temperature[heater] - temperature < HEATUP_LOSS_MIN_DROP)
+        return;
+    float rate = (temperature - heatup_rate_start_temperature[heater]) * 1000.0 / (now - heatup_rate_start_millis[heater]);
+    float above_ambient = (temperature + heatup_rate_start_temperature[heater]) / 2 - HEATUP_AMBIENT;
+    if (full_power)
+    {
+        rate += heatup_loss[heater] * above_ambient;
+        if (rate > 0)
+            heatup_rate[heater] += (rate - heatup_rate[heater]) / 4;
+    }else if (above_ambient > HEATUP_LOSS_MIN_TEMPERATURE)
+    {
+        //Without power the temperature drops by the loss, the first sample sets the loss, later ones are averaged.
+        float loss = -rate / above_ambient;
+        if (heatup_loss[heater] == 0)
+        {
+            //Until now the heating rate was learned without the loss, over a heat-up to about this temperature.
+            heatup_loss[heater] = loss;
+            heatup_rate[heater] += loss * above_ambient / 2;
+        }else{
+            heatup_loss[heater] += (loss - heatup_loss[heater]) / 4;
+        }
+    }
+    heatup_rate_start_millis[heater] = now;
+    heatup_rate_start_temperature[heater] = temperature;
+    heatup_rate_save(heater);
+}
+
+//The learned rates are kept in EEPROM after the lifetime stats, a heating rate and a loss per heater. Erased EEPROM reads as NaN,
+// which fails the range check, so the defaults stay until the first rate is learned.
+#define HEATUP_RATE_EEPROM_OFFSET 0x780
+#define HEATUP_RATE_EEPROM(heater) ((float*)(HEATUP_RATE_EEPROM_OFFSET + uint16_t(heater) * 8))
+#define HEATUP_LOSS_EEPROM(heater) ((float*)(HEATUP_RATE_EEPROM_OFFSET + uint16_t(heater) * 8 + 4))
+
+static void heatup_rate_load(uint8_t heater)
+{
+    float rate = eeprom_read_float(HEATUP_RATE_EEPROM(heater));
+    float loss = eeprom_read_float(HEATUP_LOSS_EEPROM(heater));
+    if (rate > 0 && rate < 100)
+        heatup_rate[heater] = rate;
+    if (loss > 0 && loss < 1)
+        heatup_loss[heater] = loss;
+}
+
+static void heatup_rate_save(uint8_t heater)
+{
+    heatup_rate_save_pending |= _BV(heater);
 }
 
+//Called from every manage_heater(). Writes the rates of one pending heater a byte at a time, only when the EEPROM is ready,
+// so learning never waits for the EEPROM (a blocking float write takes about 13ms). Samples scatter around the learned value,
+// so only write when it moved more than 1/16th from the stored one. A converged heater then hardly ever writes, which spares
+// the EEPROM erase cycles.
+static void heatup_rate_write()
+{
+    if (!eeprom_is_ready())
+        return;
+    if (heatup_rate_write_heater == 0xFF)
+    {
+        if (heatup_rate_save_pending == 0)
+            return;
+        uint8_t heater = 0;
+        while(!(heatup_rate_save_pending & _BV(heater)))
+            heater++;
+        heatup_rate_save_pending &= ~_BV(heater);
+        float rate = eeprom_read_float(HEATUP_RATE_EEPROM(heater));
+        float loss = eeprom_read_float(HEATUP_LOSS_EEPROM(heater));
+        bool changed = false;
+        if (!(fabs(heatup_rate[heater] - rate) <= heatup_rate[heater] / 16))
+        {
+            rate = heatup_rate[heater];
+            changed = true;
+        }
+        if (heatup_loss[heater] > 0 && !(fabs(heatup_loss[heater] - loss) <= heatup_loss[heater] / 16))
+        {
+            loss = heatup_loss[heater];
+            changed = true;
+        }
+        if (!changed)
+            return;
+        heatup_rate_write_data[0] = rate;
+        heatup_rate_write_data[1] = loss;
+        heatup_rate_write_heater = heater;
+        heatup_rate_write_index = 0;
+    }
+
+    //Start writing the next byte that differs, the EEPROM finishes it in the background.
+    uint8_t* address = (uint8_t*)HEATUP_RATE_EEPROM(heatup_rate_write_heater);
+    while(heatup_rate_write_index < sizeof(heatup_rate_write_data))
+    {
+        uint8_t data = ((uint8_t*)heatup_rate_write_data)[heatup_rate_write_index];
+        if (eeprom_read_byte(address + heatup_rate_write_index++) != data)
+        {
+            eeprom_write_byte(address + heatup_rate_write_index - 1, data);
+            break;
+        }
+    }
+    if (heatup_rate_write_index >= sizeof(heatup_rate_write_data))
+        heatup_rate_write_heater = 0xFF;
+}
+
+#if TEMP_SENSOR_BED != 0
+void heatupDelayBed(unsigned int seconds)
+{
+    heatup_bed_delay_millis = seconds ? millis() + seconds * 1000UL : 0;
+}
+
+bool heatupBedDelayed()
+{
+    if (heatup_bed_delay_millis == 0)
+        return false;
+    if ((long)(millis() - heatup_bed_delay_millis) < 0)
+        return true;
+    heatup_bed_delay_millis = 0;
+    return false;
+}
+#endif
+
+unsigned int heatupSeconds(uint8_t heater, int target)
+{
+    float temperature = (heater == HEATUP_BED) ? current_temperature_bed : current_temperature[heater];
+    if (temperature >= target)
+        return 0;
+    //The loss grows while heating, use the loss halfway to the target.
+    float rate = heatup_rate[heater] - heatup_loss[heater] * ((temperature + target) / 2 - HEATUP_AMBIENT);
+    return (target - temperature) / max(rate, 0.05);
+}
+#endif
+
+#ifdef HEATER_MODEL_CHECK
+//Compare the measured temperature change with the change predicted from the heater power (soft_pwm still holds the power
+// requested since the previous measurement, SOFT_PWM_APPLIED takes the power budget into account) and the heating rate and loss
+// learned by heatup_rate_learn(). The model is restarted from the measured temperature every window, so it never drifts.
+// It only runs while the hotend has a target and its loss has been learned, a cooling hotend is never checked.
+static void heater_model_check(uint8_t e)
+{
+    unsigned long now = millis();
+    if (IsStopped() || heater_model_start_millis[e] == 0 || target_temperature[e] == 0 || heatup_loss[e] == 0)
+    {
+        heater_model_start_millis[e] = now;
+        heater_model_last_millis[e] = now;
+        heater_model_start_temperature[e] = current_temperature[e];
+        heater_model_expected[e] = 0;
+        heater_model_faults[e] = 0;
+        return;
+    }
+    float dt = (now - heater_model_last_millis[e]) / 1000.0;
+    heater_model_last_millis[e] = now;
+    heater_model_expected[e] += dt * (heatup_rate[e] * SOFT_PWM_APPLIED(e) / (PID_MAX >> 1) - heatup_loss[e] * (current_temperature[e] - HEATUP_AMBIENT));
+    if (now - heater_model_start_millis[e] < HEATER_MODEL_WINDOW)
+        return;
+
+    float residual = current_temperature[e] - heater_model_start_temperature[e] - heater_model_expected[e];
+    heater_model_start_millis[e] = now;
+    heater_model_start_temperature[e] = current_temperature[e];
+    heater_model_expected[e] = 0;
+
+    if (residual < -HEATER_MODEL_TOLERANCE)
+        heater_model_faults[e] = (heater_model_faults[e] < 0) ? heater_model_faults[e] - 1 : -1;
+    else if (residual > HEATER_MODEL_TOLERANCE)
+        heater_model_faults[e] = (heater_model_faults[e] > 0) ? heater_model_faults[e] + 1 : 1;
+    else
+        heater_model_faults[e] = 0;
+
+    if (heater_model_faults[e] > -HEATER_MODEL_FAULT_WINDOWS && heater_model_faults[e] < HEATER_MODEL_FAULT_WINDOWS)
+        return;
+    //Too cold: the heater is not working, the sensor is not measuring the heater block or the hotend is cooled too much.
+    //Too hot: the heater is on while it should not be, or the sensor reads temperatures the heater cannot produce.
+    disable_heater();
+    SERIAL_ERROR_START;
+    SERIAL_ERRORLN((int)e);
+    SERIAL_ERRORPGM(": Extruder switched off. Temperature deviates from heater model by ");
+    SERIAL_ERRORLN(residual);
+    LCD_ALERTMESSAGEPGM("Err: HEATER MODEL");
+    Stop(heater_model_faults[e] < 0 ? STOP_REASON_HEATER_ERROR : STOP_REASON_HEATER_RUNAWAY);
+}
+#endif
+
 void max_temp_error(uint8_t e) {
   disable_heater();
   if(IsStopped() == false) {
@@ -1089,143 +1648,290 @@ static int read_max6675()
 #endif
 
 
-// Timer 0 is shared with millies
-ISR(TIMER0_COMPB_vect)
+// Soft PWM channels, every heater (and the fan) is one bit in the masks below.
+#define SOFT_PWM_CH_0   0
+#define SOFT_PWM_CH_1   1
+#define SOFT_PWM_CH_2   2
+#define SOFT_PWM_CH_BED 3
+#define SOFT_PWM_CH_FAN 4
+#define SOFT_PWM_CHANNELS 5
+
+// Switch schedule of the current PWM period, sorted on pwm_count. Channels that switch on the same count share an entry.
+// Every channel has at most a switch-on and a switch-off event in a period.
+#define SOFT_PWM_EVENTS (SOFT_PWM_CHANNELS * 2)
+static unsigned char soft_pwm_event_at[SOFT_PWM_EVENTS];
+static unsigned char soft_pwm_on_mask[SOFT_PWM_EVENTS];
+static unsigned char soft_pwm_off_mask[SOFT_PWM_EVENTS];
+static unsigned char soft_pwm_event_count;
+static unsigned char soft_pwm_next_event;
+
+static FORCE_INLINE void soft_pwm_write(unsigned char mask, unsigned char level)
 {
-  //these variables are only accesible from the ISR, but static, so they don't lose their value
-  static unsigned char temp_count = 0;
-  static unsigned long raw_temp_0_value = 0;
-  static unsigned long raw_temp_1_value = 0;
-  static unsigned long raw_temp_2_value = 0;
-  static unsigned long raw_temp_bed_value = 0;
-  static unsigned char temp_state = 5;
-  static unsigned char pwm_count = (1 << SOFT_PWM_SCALE);
-  static unsigned char soft_pwm_0;
+  if(mask & _BV(SOFT_PWM_CH_0)) WRITE(HEATER_0_PIN, level);
   #if EXTRUDERS > 1
-  static unsigned char soft_pwm_1;
+  if(mask & _BV(SOFT_PWM_CH_1)) WRITE(HEATER_1_PIN, level);
   #endif
   #if EXTRUDERS > 2
-  static unsigned char soft_pwm_2;
+  if(mask & _BV(SOFT_PWM_CH_2)) WRITE(HEATER_2_PIN, level);
   #endif
-  #if HEATER_BED_PIN > -1
-  static unsigned char soft_pwm_b;
+  #if defined(HEATER_BED_PIN) && HEATER_BED_PIN > -1
+  if(mask & _BV(SOFT_PWM_CH_BED)) WRITE(HEATER_BED_PIN, level);
   #endif
+  #ifdef FAN_SOFT_PWM
+  if(mask & _BV(SOFT_PWM_CH_FAN)) WRITE(FAN_PIN, level);
+  #endif
+}
 
-  if(pwm_count == 0){
-    soft_pwm_0 = soft_pwm[0];
-    if(soft_pwm_0 > 0) WRITE(HEATER_0_PIN,1);
-    #if EXTRUDERS > 1
-    soft_pwm_1 = soft_pwm[1];
-    if(soft_pwm_1 > 0) WRITE(HEATER_1_PIN,1);
-    #endif
-    #if EXTRUDERS > 2
-    soft_pwm_2 = soft_pwm[2];
-    if(soft_pwm_2 > 0) WRITE(HEATER_2_PIN,1);
-    #endif
-    #if defined(HEATER_BED_PIN) && HEATER_BED_PIN > -1
-    soft_pwm_b = soft_pwm_bed;
-    if(soft_pwm_b > 0) WRITE(HEATER_BED_PIN,1);
-    #endif
-    #ifdef FAN_SOFT_PWM
-    soft_pwm_fan = fanSpeedSoftPwm / 2;
-    if(soft_pwm_fan > 0) WRITE(FAN_PIN,1);
-    #endif
+// Add a switch event to the schedule, or merge it with the event that is already there for the same pwm_count.
+static FORCE_INLINE void soft_pwm_add_event(unsigned char at, unsigned char on_mask, unsigned char off_mask)
+{
+  unsigned char n = soft_pwm_event_count;
+  while(n > 0 && soft_pwm_event_at[n - 1] >= at)
+  {
+    if(soft_pwm_event_at[n - 1] == at)
+    {
+      //Shift the later entries back to where they were and share this one.
+      soft_pwm_on_mask[n - 1] |= on_mask;
+      soft_pwm_off_mask[n - 1] |= off_mask;
+      for(; n < soft_pwm_event_count; n++)
+      {
+        soft_pwm_event_at[n] = soft_pwm_event_at[n + 1];
+        soft_pwm_on_mask[n] = soft_pwm_on_mask[n + 1];
+        soft_pwm_off_mask[n] = soft_pwm_off_mask[n + 1];
+      }
+      return;
+    }
+    soft_pwm_event_at[n] = soft_pwm_event_at[n - 1];
+    soft_pwm_on_mask[n] = soft_pwm_on_mask[n - 1];
+    soft_pwm_off_mask[n] = soft_pwm_off_mask[n - 1];
+    n--;
   }
-  if(soft_pwm_0 <= pwm_count) WRITE(HEATER_0_PIN,0);
+  soft_pwm_event_at[n] = at;
+  soft_pwm_on_mask[n] = on_mask;
+  soft_pwm_off_mask[n] = off_mask;
+  soft_pwm_event_count++;
+}
+
+// Schedule a channel that is on for duty counts from pwm_count phase on, wrapping around the end of the period.
+// pwm_count only takes multiples of (1 << SOFT_PWM_SCALE), so round up to the first count that switches the channel.
+#define SOFT_PWM_ROUND(count) (((count) + (1 << SOFT_PWM_SCALE) - 1) & ~((1 << SOFT_PWM_SCALE) - 1))
+static FORCE_INLINE void soft_pwm_schedule(unsigned char duty, unsigned char phase, unsigned char channel, unsigned char &on_mask)
+{
+  if(duty == 0)
+    return;
+  unsigned int on_count = SOFT_PWM_ROUND((unsigned int)phase);
+  unsigned int off_count = SOFT_PWM_ROUND((unsigned int)phase + duty);
+  if(on_count > 0x7f)
+  {
+    on_count -= 0x80;
+    off_count -= 0x80;
+  }
+  if(on_count == 0)
+    on_mask |= _BV(channel);
+  else
+    soft_pwm_add_event(on_count, _BV(channel), 0);
+  if(off_count > 0x80)
+  {
+    //The on-time wraps around, so the channel is also on at the start of the period.
+    on_mask |= _BV(channel);
+    soft_pwm_add_event(off_count - 0x80, 0, _BV(channel));
+  }
+  else if(off_count < 0x80) //Else does not switch off in this period
+  {
+    soft_pwm_add_event(off_count, 0, _BV(channel));
+  }
+}
+
+// The schedule of the running period was latched from the old duty cycles. Drop its heater switch-on events and switch the heaters
+// off, so a heater that is disabled halfway through the period does not come back on until the period ends.
+static void soft_pwm_cancel_heaters()
+{
+  CRITICAL_SECTION_START;
+  for(unsigned char n = soft_pwm_next_event; n < soft_pwm_event_count; n++)
+    soft_pwm_on_mask[n] &= _BV(SOFT_PWM_CH_FAN);
+  soft_pwm_write(~_BV(SOFT_PWM_CH_FAN), 0);
+  CRITICAL_SECTION_END;
+}
+
+// Latch the requested duty cycles at the start of a PWM period and turn on every channel that is on at pwm_count 0.
+static FORCE_INLINE void soft_pwm_start_period()
+{
+  unsigned char on_mask = 0;
+  soft_pwm_event_count = 0;
+  soft_pwm_next_event = 0;
+  soft_pwm_schedule(SOFT_PWM_APPLIED(0), SOFT_PWM_PHASE(0), SOFT_PWM_CH_0, on_mask);
   #if EXTRUDERS > 1
-  if(soft_pwm_1 <= pwm_count) WRITE(HEATER_1_PIN,0);
+  soft_pwm_schedule(SOFT_PWM_APPLIED(1), SOFT_PWM_PHASE(1), SOFT_PWM_CH_1, on_mask);
   #endif
   #if EXTRUDERS > 2
-  if(soft_pwm_2 <= pwm_count) WRITE(HEATER_2_PIN,0);
+  soft_pwm_schedule(SOFT_PWM_APPLIED(2), SOFT_PWM_PHASE(2), SOFT_PWM_CH_2, on_mask);
   #endif
   #if defined(HEATER_BED_PIN) && HEATER_BED_PIN > -1
-  if(soft_pwm_b <= pwm_count) WRITE(HEATER_BED_PIN,0);
+  soft_pwm_schedule(SOFT_PWM_APPLIED_BED, SOFT_PWM_PHASE_BED, SOFT_PWM_CH_BED, on_mask);
   #endif
   #ifdef FAN_SOFT_PWM
-  if(soft_pwm_fan <= pwm_count) WRITE(FAN_PIN,0);
+  soft_pwm_fan = fanSpeedSoftPwm / 2;
+  soft_pwm_schedule(soft_pwm_fan, 0, SOFT_PWM_CH_FAN, on_mask);
+  #endif
+  soft_pwm_write(on_mask, 1);
+  soft_pwm_write(~on_mask, 0);
+}
+
+#ifdef HEATER_POWER_BUDGET
+// Place the on-times of the heaters one after the other in the PWM period, in priority order. A heater starts where the previous
+// one ended, as that is where the fewest heaters are on, and is cut short at the first count where the budget would be exceeded.
+// Runs outside the ISR, every temperature measurement.
+static void power_budget_apply()
+{
+  static const int extruder_watts[EXTRUDERS] = ARRAY_BY_EXTRUDERS(HEATER_0_WATTS, HEATER_1_WATTS, HEATER_2_WATTS);
+  unsigned char heater[EXTRUDERS + 1]; //Extruder number, EXTRUDERS for the bed
+  unsigned char start[EXTRUDERS + 1];
+  unsigned char length[EXTRUDERS + 1];
+  int watts[EXTRUDERS + 1];
+  unsigned char count = 0;
+
+  #ifdef HEATER_POWER_BED_FIRST
+  heater[count++] = EXTRUDERS;
   #endif
+  heater[count++] = active_extruder;
+  for(unsigned char e = 0; e < EXTRUDERS; e++)
+    if(e != active_extruder)
+      heater[count++] = e;
+  #ifndef HEATER_POWER_BED_FIRST
+  heater[count++] = EXTRUDERS;
+  #endif
+
+  unsigned char phase = 0;
+  for(unsigned char n = 0; n < count; n++)
+  {
+    unsigned char duty = (heater[n] == EXTRUDERS) ? soft_pwm_bed : soft_pwm[heater[n]];
+    watts[n] = (heater[n] == EXTRUDERS) ? HEATER_BED_WATTS : extruder_watts[heater[n]];
+    unsigned char t = phase;
+    unsigned char len = 0;
+    while(len < duty)
+    {
+      //Load of the heaters placed so far at count t, and the number of counts it stays the same.
+      int load = watts[n];
+      unsigned char step = duty - len;
+      for(unsigned char i = 0; i < n; i++)
+      {
+        unsigned char offset = (t - start[i]) & 0x7f;
+        if(offset < length[i])
+        {
+          load += watts[i];
+          step = min(step, length[i] - offset);
+        }else{
+          step = min(step, 0x80 - offset);
+        }
+      }
+      if(load > HEATER_POWER_BUDGET)
+        break;
+      len += step;
+      t = (t + step) & 0x7f;
+    }
+    start[n] = phase;
+    length[n] = len;
+    phase = (phase + len) & 0x7f;
+  }
+
+  CRITICAL_SECTION_START;
+  for(unsigned char n = 0; n < count; n++)
+  {
+    if(heater[n] == EXTRUDERS)
+    {
+      soft_pwm_limit_bed = length[n];
+      soft_pwm_phase_bed = start[n];
+    }else{
+      soft_pwm_limit[heater[n]] = length[n];
+      soft_pwm_phase[heater[n]] = start[n];
+    }
+  }
+  CRITICAL_SECTION_END;
+}
+#endif
+
+// ADC sequence, one conversion per tick: TEMP_0, TEMP_BED, TEMP_1, TEMP_2.
+// Slots without a sensor stay in the table, so a full round always takes 4 ticks. PID_dT depends on that.
+#define ADC_SLOTS 4
+#define ADC_SLOT_TEMP_0   0
+#define ADC_SLOT_TEMP_BED 1
+#define ADC_SLOT_TEMP_1   2
+#define ADC_SLOT_TEMP_2   3
+#define ADC_SLOT(pin) { (1 << REFS0) | ((pin) & 0x07), ((pin) > 7) ? (1 << MUX5) : 0 }
+#define ADC_SLOT_NONE { 0, 0 }
+
+struct adc_slot_t
+{
+  unsigned char admux;  // 0 for a slot without a sensor
+  unsigned char adcsrb;
+};
+
+static const adc_slot_t adc_slots[ADC_SLOTS] = {
+#if defined(TEMP_0_PIN) && (TEMP_0_PIN > -1)
+  ADC_SLOT(TEMP_0_PIN),
+#else
+  ADC_SLOT_NONE,
+#endif
+#if defined(TEMP_BED_PIN) && (TEMP_BED_PIN > -1)
+  ADC_SLOT(TEMP_BED_PIN),
+#else
+  ADC_SLOT_NONE,
+#endif
+#if defined(TEMP_1_PIN) && (TEMP_1_PIN > -1) && EXTRUDERS > 1
+  ADC_SLOT(TEMP_1_PIN),
+#else
+  ADC_SLOT_NONE,
+#endif
+#if defined(TEMP_2_PIN) && (TEMP_2_PIN > -1) && EXTRUDERS > 2
+  ADC_SLOT(TEMP_2_PIN),
+#else
+  ADC_SLOT_NONE,
+#endif
+};
+
+// Timer 0 is shared with millies
+ISR(TIMER0_COMPB_vect)
+{
+  //these variables are only accesible from the ISR, but static, so they don't lose their value
+  static unsigned char temp_count = 0;
+  static unsigned long raw_temp_value[ADC_SLOTS] = { 0 };
+  static unsigned char adc_slot = ADC_SLOTS + 1; //Startup, delay initial temp reading a tiny bit so the hardware can settle.
+  static unsigned char pwm_count = (1 << SOFT_PWM_SCALE);
+
+  if(pwm_count == 0)
+    soft_pwm_start_period();
+  else if(soft_pwm_next_event < soft_pwm_event_count && soft_pwm_event_at[soft_pwm_next_event] == pwm_count)
+  {
+    //Switch off first, so a heater taking over from another one at the same count never overlaps with it.
+    soft_pwm_write(soft_pwm_off_mask[soft_pwm_next_event], 0);
+    soft_pwm_write(soft_pwm_on_mask[soft_pwm_next_event++], 1);
+  }
 
   pwm_count += (1 << SOFT_PWM_SCALE);
   pwm_count &= 0x7f;
 
-  switch(temp_state) {
-    case 1: // Measure TEMP_0
-      #if defined(TEMP_0_PIN) && (TEMP_0_PIN > -1)
-        raw_temp_0_value += ADC;
-      #endif
-      // Prepare TEMP_BED
-      #if defined(TEMP_BED_PIN) && (TEMP_BED_PIN > -1)
-        #if TEMP_BED_PIN > 7
-          ADCSRB = 1<<MUX5;
-        #else
-          ADCSRB = 0;
-        #endif
-        ADMUX = ((1 << REFS0) | (TEMP_BED_PIN & 0x07));
-        ADCSRA |= 1<<ADSC; // Start conversion
-      #endif
-      lcd_buttons_update();
-      temp_state = 2;
-      break;
-    case 2: // Measure TEMP_BED
-      #if defined(TEMP_BED_PIN) && (TEMP_BED_PIN > -1)
-        raw_temp_bed_value += ADC;
-      #endif
-      // Prepare TEMP_1
-      #if defined(TEMP_1_PIN) && (TEMP_1_PIN > -1) && EXTRUDERS > 1
-        #if TEMP_1_PIN > 7
-          ADCSRB = 1<<MUX5;
-        #else
-          ADCSRB = 0;
-        #endif
-        ADMUX = ((1 << REFS0) | (TEMP_1_PIN & 0x07));
-        ADCSRA |= 1<<ADSC; // Start conversion
-      #endif
-      lcd_buttons_update();
-      temp_state = 3;
-      break;
-    case 3: // Measure TEMP_1
-      #if defined(TEMP_1_PIN) && (TEMP_1_PIN > -1) && EXTRUDERS > 1
-        raw_temp_1_value += ADC;
-      #endif
-      // Prepare TEMP_2
-      #if defined(TEMP_2_PIN) && (TEMP_2_PIN > -1) && EXTRUDERS > 2
-        #if TEMP_2_PIN > 7
-          ADCSRB = 1<<MUX5;
-        #else
-          ADCSRB = 0;
-        #endif
-        ADMUX = ((1 << REFS0) | (TEMP_2_PIN & 0x07));
-        ADCSRA |= 1<<ADSC; // Start conversion
-      #endif
-      lcd_buttons_update();
-      temp_state = 4;
-      break;
-    case 4: // Measure TEMP_2
-      #if defined(TEMP_2_PIN) && (TEMP_2_PIN > -1) && EXTRUDERS > 2
-        raw_temp_2_value += ADC;
-      #endif
-      temp_count++;
-      //Fall trough to state 0
-    case 0: // Prepare TEMP_0
-      #if defined(TEMP_0_PIN) && (TEMP_0_PIN > -1)
-        #if TEMP_0_PIN > 7
-          ADCSRB = 1<<MUX5;
-        #else
-          ADCSRB = 0;
-        #endif
-        ADMUX = ((1 << REFS0) | (TEMP_0_PIN & 0x07));
-        ADCSRA |= 1<<ADSC; // Start conversion
-      #endif
-      lcd_buttons_update();
-      temp_state = 1;
-      break;
-    case 5: //Startup, delay initial temp reading a tiny bit so the hardware can settle.
-      temp_state = 0;
-      break;
-//    default:
-//      SERIAL_ERROR_START;
-//      SERIAL_ERRORLNPGM("Temp measurement error!");
-//      break;
+  if(adc_slot > ADC_SLOTS)
+  {
+    adc_slot = ADC_SLOTS;
+  }else{
+    if(adc_slot < ADC_SLOTS)
+    {
+      // Collect the conversion that was started on the previous tick
+      if(adc_slots[adc_slot].admux)
+        raw_temp_value[adc_slot] += ADC;
+      adc_slot = (adc_slot + 1) & (ADC_SLOTS - 1);
+      if(adc_slot == 0)
+        temp_count++;
+    }else{
+      adc_slot = 0;
+    }
+    if(adc_slots[adc_slot].admux)
+    {
+      ADCSRB = adc_slots[adc_slot].adcsrb;
+      ADMUX = adc_slots[adc_slot].admux;
+      ADCSRA |= 1<<ADSC; // Start conversion
+    }
+    lcd_buttons_update();
   }
 
   if(temp_count >= OVERSAMPLENR) // 8 ms * 16 = 128ms.
@@ -1233,26 +1939,24 @@ ISR(TIMER0_COMPB_vect)
     if (!temp_meas_ready) //Only update the raw values if they have been read. Else we could be updating them during reading.
     {
 #ifndef HEATER_0_USES_MAX6675
-      current_temperature_raw[0] = raw_temp_0_value;
+      current_temperature_raw[0] = raw_temp_value[ADC_SLOT_TEMP_0];
 #endif
 #if EXTRUDERS > 1
-      current_temperature_raw[1] = raw_temp_1_value;
+      current_temperature_raw[1] = raw_temp_value[ADC_SLOT_TEMP_1];
 #endif
 #ifdef TEMP_SENSOR_1_AS_REDUNDANT
-      redundant_temperature_raw = raw_temp_1_value;
+      redundant_temperature_raw = raw_temp_value[ADC_SLOT_TEMP_1];
 #endif
 #if EXTRUDERS > 2
-      current_temperature_raw[2] = raw_temp_2_value;
+      current_temperature_raw[2] = raw_temp_value[ADC_SLOT_TEMP_2];
 #endif
-      current_temperature_bed_raw = raw_temp_bed_value;
+      current_temperature_bed_raw = raw_temp_value[ADC_SLOT_TEMP_BED];
     }
 
     temp_meas_ready = true;
     temp_count = 0;
-    raw_temp_0_value = 0;
-    raw_temp_1_value = 0;
-    raw_temp_2_value = 0;
-    raw_temp_bed_value = 0;
+    for(unsigned char n = 0; n < ADC_SLOTS; n++)
+      raw_temp_value[n] = 0;
 
 #if HEATER_0_RAW_LO_TEMP > HEATER_0_RAW_HI_TEMP
     if(current_temperature_raw[0] <= maxttemp_raw[0]) {
@@ -42,7 +42,10 @@ extern float current_temperature_bed;
 #endif
 
 #ifdef PIDTEMP
-  extern float Kp,Ki,Kd,Kc;
+  extern float Kp,Ki,Kd;
+  #ifdef PID_ADD_EXTRUSION_RATE
+  extern float Kc[EXTRUDERS];
+  #endif
   float scalePID_i(float i);
   float scalePID_d(float d);
   float unscalePID_i(float i);
@@ -150,5 +153,38 @@ FORCE_INLINE void autotempShutdown(){
 
 void PID_autotune(float temp, int extruder, int ncycles);
 
+#ifdef HEATUP_SYNCHRONIZE
+#define HEATUP_BED EXTRUDERS // heater index of the bed, the extruders use their own number
+unsigned int heatupSeconds(uint8_t heater, int target);
+#if TEMP_SENSOR_BED != 0
+// Keep the bed heater off for the given number of seconds while target_temperature_bed stays set, 0 starts it at once.
+void heatupDelayBed(unsigned int seconds);
+bool heatupBedDelayed();
+#endif
+#endif
+
+#ifdef TEMP_HISTORY
+// The heated bed is the last heater in a sample, after the extruders.
+#if TEMP_SENSOR_BED != 0
+  #define TEMP_HISTORY_HEATERS (EXTRUDERS + 1)
+#else
+  #define TEMP_HISTORY_HEATERS EXTRUDERS
+#endif
+#define TEMP_HISTORY_TEMP_SCALE 16
+
+struct tempHistorySample
+{
+  uint16_t time;                                 // millis() / 10
+  int16_t temperature[TEMP_HISTORY_HEATERS];     // In 1/TEMP_HISTORY_TEMP_SCALE degree C
+  int16_t target[TEMP_HISTORY_HEATERS];          // In degree C
+  uint8_t pwm[TEMP_HISTORY_HEATERS];             // Soft PWM value, as M105 reports it with @:
+};
+
+extern bool temp_history_stream;
+uint8_t temp_history_count();
+const tempHistorySample* temp_history_get(uint8_t index); // index 0 is the oldest sample
+void temp_history_dump();
+#endif
+
 #endif
 
@@ -41,6 +41,8 @@
 
 extern uint8_t __eeprom__storage[4096];
 
+#define eeprom_is_ready() 1
+
 static inline uint8_t eeprom_read_byte (const uint8_t *__p)
 {
     return __eeprom__storage[int(__p)];
@@ -28,6 +28,11 @@ static inline uint16_t pgm_read_word(const void* ptr)
     return *(const uint16_t*)ptr;
 }
 
+static inline uint32_t pgm_read_dword(const void* ptr)
+{
+    return *(const uint32_t*)ptr;
+}
+
 static inline float pgm_read_float(const void* ptr)
 {
     return *(const float*)ptr;
@@ -35,6 +40,7 @@ static inline float pgm_read_float(const void* ptr)
 
 #define pgm_read_byte_near(n) pgm_read_byte(n)
 #define pgm_read_word_near(n) pgm_read_word(n)
+#define pgm_read_dword_near(n) pgm_read_dword(n)
 #define pgm_read_float_near(n) pgm_read_float(n)
 
 /* Cheating some none-standard C functions in here (normally provided by avr-libc), so WString.h of Arduino sees this function */
@@ -19,6 +19,9 @@ extern void TWI_vect();
 extern void TIMER0_OVF_vect();
 extern void TIMER0_COMPB_vect();
 extern void TIMER1_COMPA_vect();
+#if TX_BUFFER_SIZE > 0
+extern void USART0_UDRE_vect();
+#endif
 
 unsigned int prevTicks = SDL_GetTicks();
 unsigned int twiIntStart = 0;
@@ -54,6 +57,17 @@ void sim_check_interrupts()
     }
 #endif
     
+#if TX_BUFFER_SIZE > 0
+    //The simulated UART is always ready, so send the whole transmit buffer at once.
+    if (UCSR0B & _BV(UDRIE0))
+    {
+        cli();
+        while(UCSR0B & _BV(UDRIE0))
+            USART0_UDRE_vect();
+        _sei();
+    }
+#endif
+
     //if (tickDiff > 1)
     //    printf("Ticks slow! %i\n", tickDiff);
     if (tickDiff > 0)
@@ -1,14 +1,24 @@
 #include "heater.h"
 #include "arduinoIO.h"
 
+//First order thermal model, in degC per second at full power and the fraction of the temperature above ambient lost per second,
+// with a sensor that follows the heater block with a delay in seconds. Rough figures of a UM2 hotend, the firmware does not know
+// them and has to learn its own.
+#define HEATER_SIM_HEATING_RATE 3.3
+#define HEATER_SIM_COOLING_RATE 0.0055
+#define HEATER_SIM_SENSOR_LAG 2.0
+#define HEATER_SIM_AMBIENT 20
+
 heaterSim::heaterSim(int heaterPinNr, adcSim* adc, int temperatureADCNr, float heaterStrength)
 {
     this->heaterPinNr = heaterPinNr;
     this->adc = adc;
     this->temperatureADCNr = temperatureADCNr;
     this->heaterStrength = heaterStrength;
+    this->fault = HEATER_FAULT_NONE;
     
-    this->temperature = 20;
+    this->temperature = HEATER_SIM_AMBIENT;
+    this->sensorTemperature = HEATER_SIM_AMBIENT;
 }
 
 heaterSim::~heaterSim()
@@ -17,16 +27,31 @@ heaterSim::~heaterSim()
 
 void heaterSim::tick()
 {
-    if (readOutput(heaterPinNr))
-        temperature += 0.03 * heaterStrength;
-    else if (temperature > 20)
-        temperature -= 0.03 * heaterStrength;
-    adc->adcValue[temperatureADCNr] = 231 + temperature * 81 / 100;//Not accurate, but accurate enough.
+    bool on = readOutput(heaterPinNr);
+    if (fault == HEATER_FAULT_HEATER_BROKEN)
+        on = false;
+    if (fault == HEATER_FAULT_STUCK_ON)
+        on = true;
+    float cooling = HEATER_SIM_COOLING_RATE;
+    if (fault == HEATER_FAULT_COOLING)
+        cooling *= 5;
+
+    //tick() is called about every ms
+    if (on)
+        temperature += HEATER_SIM_HEATING_RATE * heaterStrength / 1000.0;
+    temperature -= cooling * (temperature - HEATER_SIM_AMBIENT) / 1000.0;
+
+    if (fault == HEATER_FAULT_SENSOR_LOOSE)
+        sensorTemperature -= 0.05 * (sensorTemperature - HEATER_SIM_AMBIENT) / 1000.0;
+    else
+        sensorTemperature += (temperature - sensorTemperature) / (HEATER_SIM_SENSOR_LAG * 1000.0);
+    adc->adcValue[temperatureADCNr] = 231 + sensorTemperature * 81 / 100;//Not accurate, but accurate enough.
 }
 
 void heaterSim::draw(int x, int y)
 {
+    static const char* faultName[HEATER_FAULT_COUNT] = {"", " broken", " loose", " cooled", " stuck"};
     char buffer[32];
-    sprintf(buffer, "%iC", int(temperature));
+    sprintf(buffer, "%iC%s", int(sensorTemperature), faultName[fault]);
     drawString(x, y, buffer, 0xFFFFFF);
 }
@@ -4,6 +4,13 @@
 #include "base.h"
 #include "adc.h"
 
+#define HEATER_FAULT_NONE           0
+#define HEATER_FAULT_HEATER_BROKEN  1  //Heater cartridge does not heat anymore
+#define HEATER_FAULT_SENSOR_LOOSE   2  //Temperature sensor fell out of the heater block
+#define HEATER_FAULT_COOLING        3  //Strong airflow on the heater block
+#define HEATER_FAULT_STUCK_ON       4  //Heater is always on, no matter what the output pin says
+#define HEATER_FAULT_COUNT          5
+
 class heaterSim : public simBaseComponent
 {
 public:
@@ -12,9 +19,14 @@ public:
     
     virtual void tick();
     virtual void draw(int x, int y);
+
+    void setFault(int fault) { this->fault = fault; }
+    int getFault() { return fault; }
 private:
     float temperature;
+    float sensorTemperature;
     float heaterStrength;
+    int fault;
 
     int heaterPinNr;
     adcSim* adc;
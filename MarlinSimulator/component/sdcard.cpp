@@ -193,6 +193,11 @@ void sdcardSimulation::ISP_SPDR_callback(uint8_t oldValue, uint8_t& newValue)
         SPSR |= _BV(SPIF);//Mark transfer finished
         return;
     }
+    if (sd_state == 11 && sd_buffer_pos == 0 && (newValue & 0xC0) == 0x40)
+    {
+        //Command between the blocks of a multiple block read (normally CMD12), the card stops streaming
+        sd_state = 0;
+    }
     switch(sd_state)
     {
     case 0://Read CMD
@@ -225,6 +230,13 @@ void sdcardSimulation::ISP_SPDR_callback(uint8_t oldValue, uint8_t& newValue)
             sd_state = 10;
             sd_buffer_pos = 0;
             break;
+        case 0x12://CMD18 - READ_MULTIPLE_BLOCK
+            newValue = 0x00;//R1_READY_STATE
+            sd_read_block_nr = (sd_buffer[1] << 24) | (sd_buffer[2] << 16) | (sd_buffer[3] << 8) | (sd_buffer[4] << 0);
+            read_sd_block(sd_read_block_nr >> 9);
+            sd_state = 11;
+            sd_buffer_pos = 0;
+            break;
         case 0x37://CMD55 - APP_CMD
             sd_state = 2;
             break;
@@ -248,6 +260,7 @@ void sdcardSimulation::ISP_SPDR_callback(uint8_t oldValue, uint8_t& newValue)
         }
         break;
     case 10://READ BLOCK
+    case 11://READ MULTIPLE BLOCK
         if (sd_buffer_pos == 0)
             newValue = 0xFE;//DATA_START_BLOCK
         else
@@ -256,8 +269,14 @@ void sdcardSimulation::ISP_SPDR_callback(uint8_t oldValue, uint8_t& newValue)
         sd_buffer_pos++;
         if (sd_buffer_pos == 512 + 1 + 2)
         {
-            sd_state = 0;
             sd_buffer_pos = 0;
+            if (sd_state == 11)
+            {
+                sd_read_block_nr += 512;
+                read_sd_block(sd_read_block_nr >> 9);
+            }else{
+                sd_state = 0;
+            }
         }
         break;
     }
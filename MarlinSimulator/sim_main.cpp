@@ -39,6 +39,8 @@ void setupGui()
     screen = SDL_SetVideoMode(1024, 600, 32, SDL_SWSURFACE);
 }
 
+heaterSim* hotendHeater;
+
 unsigned long lastUpdate = SDL_GetTicks();
 int key_delay;
 #define KEY_REPEAT_DELAY 3
@@ -70,6 +72,11 @@ void guiUpdate()
                 fclose(f);
                 exit(0);
             }
+            if (event.key.keysym.sym == SDLK_f)
+            {
+                //Cycle through the faults that can be injected into the first hotend, to test the heater model check.
+                hotendHeater->setFault((hotendHeater->getFault() + 1) % HEATER_FAULT_COUNT);
+            }
             if (event.key.keysym.sym == SDLK_p)
             {
                 SDL_Surface* tmpSurface = SDL_CreateRGBSurface(SDL_SWSURFACE, 128*SCALE,64*SCALE,32, 0, 0, 0, 0);
@@ -212,6 +219,37 @@ public:
 };
 
 
+#ifdef TEMP_HISTORY
+#define TEMP_HISTORY_DRAW_HEIGHT 60
+#define TEMP_HISTORY_DRAW_MAX_TEMP 300
+//Plot of the firmware temperature history buffer (the same data M155 reports). Bright is the temperature, dark the target, bottom bars the PWM.
+class temperatureHistorySim : public simBaseComponent
+{
+public:
+    void draw(int _x, int _y)
+    {
+        static const uint32_t colors[][2] = {{0xFF4040, 0x602020}, {0xFFC040, 0x604820}, {0xFF40FF, 0x602060}, {0x4080FF, 0x203060}};
+        drawRect(_x, _y, TEMP_HISTORY_SIZE * 2, TEMP_HISTORY_DRAW_HEIGHT + 1, 0x202020);
+        for(uint8_t n=0; n<temp_history_count(); n++)
+        {
+            const tempHistorySample* sample = temp_history_get(n);
+            for(uint8_t h=0; h<TEMP_HISTORY_HEATERS; h++)
+            {
+                const uint32_t* color = colors[(h < EXTRUDERS) ? h : 3];
+                drawRect(_x + n * 2, _y + TEMP_HISTORY_DRAW_HEIGHT - 3 - sample->pwm[h] * 3 / 128, 2, 1, color[1]);
+                drawRect(_x + n * 2, _y + historyY(sample->target[h]), 2, 1, color[1]);
+                drawRect(_x + n * 2, _y + historyY(sample->temperature[h] / TEMP_HISTORY_TEMP_SCALE), 2, 1, color[0]);
+            }
+        }
+    }
+private:
+    int historyY(int temperature)
+    {
+        return TEMP_HISTORY_DRAW_HEIGHT - constrain(temperature, 0, TEMP_HISTORY_DRAW_MAX_TEMP) * TEMP_HISTORY_DRAW_HEIGHT / TEMP_HISTORY_DRAW_MAX_TEMP;
+    }
+};
+#endif
+
 void sim_setup_main()
 {
     setupGui();
@@ -234,9 +272,13 @@ void sim_setup_main()
     e0Step->setDrawPosition(130, 100);
     e1Step->setDrawPosition(130, 110);
     
-    (new heaterSim(HEATER_0_PIN, adc, TEMP_0_PIN))->setDrawPosition(130, 70);
+    hotendHeater = new heaterSim(HEATER_0_PIN, adc, TEMP_0_PIN);
+    hotendHeater->setDrawPosition(130, 70);
     (new heaterSim(HEATER_1_PIN, adc, TEMP_1_PIN))->setDrawPosition(130, 80);
     (new heaterSim(HEATER_BED_PIN, adc, TEMP_BED_PIN, 0.2))->setDrawPosition(130, 90);
+#ifdef TEMP_HISTORY
+    (new temperatureHistorySim())->setDrawPosition(130, 125);
+#endif
     new sdcardSimulation("c:/models/", 5000);
     (new serialSim())->setDrawPosition(150, 0);
 #if defined(ULTIBOARD_V2_CONTROLLER) || defined(ENABLE_ULTILCD2)